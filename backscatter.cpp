@@ -0,0 +1,108 @@
+#include "backscatter.h"
+#include <cmath>
+
+static const char* modelNames[BACKSCATTER_MODEL_COUNT] = {"lambert", "cosine", "muhleman", "smallslope"};
+
+Backscatter::Backscatter(const BackscatterOptions& _options) : options(_options), incidenceSteps(0),
+                                                               roughnessSteps(0), scale(1)
+{
+    if (options.model == LAMBERT) return;
+
+    // 4096 x 4 bytes stays in L1, the 2D table trades incidence steps for roughness steps
+    bool rough = options.model == SMALL_SLOPE;
+    incidenceSteps = rough ? 1024 : 4096;
+    roughnessSteps = rough ? 32 : 1;
+
+    scale = 1;
+    scale = model(1, options.maxRoughness);
+
+    table.resize((size_t)incidenceSteps * roughnessSteps);
+    for (int j = 0; j < roughnessSteps; j++)
+    {
+        float ks = rough ? options.maxRoughness * j / (roughnessSteps - 1) : 0;
+        for (int i = 0; i < incidenceSteps; i++)
+        {
+            float u = (float)i / (incidenceSteps - 1);
+            table[(size_t)j * incidenceSteps + i] = model(1 - u * u, ks);
+        }
+    }
+}
+
+float Backscatter::model(float c, float ks) const
+{
+    c = std::min(std::max(c, 0.0f), 1.0f);
+    float s = std::sqrt(1 - c * c);
+
+    switch (options.model)
+    {
+        case COSINE_POWER:
+            return std::pow(c, options.exponent) / scale;
+
+        case MUHLEMAN:
+        {
+            float d = s + 0.1f * c;
+            return c / (d * d * d) / scale;
+        }
+
+        case SMALL_SLOPE:
+        {
+            // Fresnel reflectivities of the surface at the incidence and at nadir
+            float e = options.permittivity;
+            float root = std::sqrt(e - s * s);
+            float gh = (c - root) / (c + root);
+            float gv = (e * c - root) / (e * c + root);
+            float g0 = (1 - std::sqrt(e)) / (1 + std::sqrt(e));
+            g0 *= g0;
+
+            float theta = std::asin(s);
+            // sigma_vv = g cos^3 (Gv + Gh) / sqrt(p), the paper's expression is sqrt(p) itself
+            float sqrtP = 1 - std::pow(2 * theta / (float)M_PI, 1 / (3 * g0)) * std::exp(-ks);
+            float g = 0.7f * (1 - std::exp(-0.65f * std::pow(ks, 1.8f)));
+            return g * c * c * c * (gv * gv + gh * gh) / std::max(sqrtP, 1e-6f) / scale;
+        }
+
+        default:
+            return c;
+    }
+}
+
+float Backscatter::evaluate(float cosIncidence, float albedo) const
+{
+    if (cosIncidence < 0) return std::numeric_limits<float>::min() * albedo;
+    return model(cosIncidence, std::min(albedo, 1.0f) * options.maxRoughness) * albedo;
+}
+
+void Backscatter::rows(const cv::Vec3f& v2sat, const cv::Mat& Normals, const cv::Mat& Albedo, cv::Mat& reflection,
+                       int y0, int y1) const
+{
+    for (int y = y0; y < y1; y++)
+    {
+        const cv::Vec3f* normal = Normals.ptr<cv::Vec3f>(y);
+        const float* albedo = Albedo.empty() ? nullptr : Albedo.ptr<float>(y);
+        float* ref = reflection.ptr<float>(y);
+
+        for (int x = 0; x < Normals.cols; x++)
+        {
+            ref[x] = (*this)(v2sat.dot(normal[x]), albedo ? albedo[x] : 1.0f);
+        }
+    }
+}
+
+BackscatterModelType Backscatter::getModel() const
+{
+    return options.model;
+}
+
+const char* backscatterModelName(BackscatterModelType type)
+{
+    return type < BACKSCATTER_MODEL_COUNT ? modelNames[type] : "unknown";
+}
+
+BackscatterModelType backscatterModelFromName(const string& name)
+{
+    for (int i = 0; i < BACKSCATTER_MODEL_COUNT; i++)
+    {
+        if (name == modelNames[i]) return (BackscatterModelType)i;
+    }
+    return BACKSCATTER_MODEL_COUNT;
+}
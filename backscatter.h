@@ -0,0 +1,92 @@
+#ifndef HEIGHTMAP_BACKSCATTER_H
+#define HEIGHTMAP_BACKSCATTER_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+// Backscatter as a function of the local incidence angle, normalized to 1 at normal incidence
+enum BackscatterModelType
+{
+    LAMBERT,        // cos(theta), the original reflection
+    COSINE_POWER,   // cos(theta)^n, n > 1 for brighter slopes facing the radar
+    MUHLEMAN,       // cos(theta) / (sin(theta) + 0.1 cos(theta))^3, quasi-specular planetary surfaces
+    SMALL_SLOPE,    // Oh et al. 1992 vv, depends on the incidence and on the surface roughness ks
+    BACKSCATTER_MODEL_COUNT
+};
+
+struct BackscatterOptions
+{
+    BackscatterModelType model = LAMBERT;
+    // COSINE_POWER exponent
+    float exponent = 2;
+    // SMALL_SLOPE: relative permittivity of the surface and the roughness ks of an albedo 1 pixel. The albedo is the
+    // roughness proxy, ks = albedo * maxRoughness
+    float permittivity = 5;
+    float maxRoughness = 1.5;
+};
+
+// A backscatter model tabulated once per run, so that any model costs a square root and one (1D) or two (2D) linear
+// interpolations per pixel. The tables are keyed by u = sqrt(1 - cos(theta)), in which every model is smooth from
+// normal to grazing incidence; the 2D table has one row per roughness step.
+class Backscatter
+{
+public:
+    explicit Backscatter(const BackscatterOptions& = BackscatterOptions());
+
+    // backscatter of a pixel, cosIncidence = dot(v2sat, normal). Slopes facing away get the smallest positive float
+    // and LAMBERT is evaluated directly, as the original reflection was
+    inline float operator()(float cosIncidence, float albedo) const
+    {
+        if (cosIncidence < 0) return std::numeric_limits<float>::min() * albedo;
+        if (options.model == LAMBERT) return cosIncidence * albedo;
+
+        float u = std::sqrt(std::max(1 - cosIncidence, 0.0f)) * (incidenceSteps - 1);
+        int i = std::min((int)u, incidenceSteps - 2);
+        float fu = u - i;
+        const float* row = table.data();
+
+        if (roughnessSteps > 1)
+        {
+            float r = std::min(albedo, 1.0f) * (roughnessSteps - 1);
+            int j = std::min((int)r, roughnessSteps - 2);
+            float fr = r - j;
+            row += j * incidenceSteps;
+            float a = row[i] + fu * (row[i + 1] - row[i]);
+            row += incidenceSteps;
+            float b = row[i] + fu * (row[i + 1] - row[i]);
+            return (a + fr * (b - a)) * albedo;
+        }
+
+        return (row[i] + fu * (row[i + 1] - row[i])) * albedo;
+    }
+
+    // reflection rows [y0, y1) of the normals (CV_32FC3) and albedo (CV_32FC1, empty for a uniform albedo of 1)
+    void rows(const cv::Vec3f& v2sat, const cv::Mat& Normals, const cv::Mat& Albedo, cv::Mat& reflection,
+              int y0, int y1) const;
+
+    // the model without the table, for checking the interpolation
+    float evaluate(float cosIncidence, float albedo) const;
+
+    BackscatterModelType getModel() const;
+
+private:
+    BackscatterOptions options;
+    int incidenceSteps;
+    int roughnessSteps;
+    // roughnessSteps rows of incidenceSteps values
+    std::vector<float> table;
+    // model value at normal incidence (and the largest roughness for SMALL_SLOPE)
+    float scale;
+
+    float model(float cosIncidence, float ks) const;
+};
+
+const char* backscatterModelName(BackscatterModelType);
+// BACKSCATTER_MODEL_COUNT for unknown names
+BackscatterModelType backscatterModelFromName(const string&);
+
+#endif //HEIGHTMAP_BACKSCATTER_H
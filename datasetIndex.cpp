@@ -0,0 +1,262 @@
+#include "datasetIndex.h"
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+static const char indexMagic[8] = {'H', 'M', 'I', 'D', 'X', 0, 0, 0};
+
+// on-disk directory entry of one column
+struct ColumnEntry
+{
+    char name[48];
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;    // from the start of the file, 8 byte aligned
+    uint64_t bytes;     // values; strings: (rows + 1) uint64 offsets followed by the bytes
+};
+
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint64_t rows;
+};
+
+static size_t typeSize(uint32_t type)
+{
+    return type == DatasetIndex::STRING ? 1 : 4;
+}
+
+DatasetIndex::Column& DatasetIndex::column(const string& name, ColumnType type)
+{
+    auto it = byName.find(name);
+    if (it != byName.end())
+    {
+        // appending values of another width would shift every later row of the column
+        CV_Assert(columns[it->second].type == type);
+        return columns[it->second];
+    }
+
+    CV_Assert(rowCount == 0 && name.size() < sizeof(ColumnEntry().name));
+    byName[name] = columns.size();
+    columns.push_back({name, type, {}, {}});
+    if (type == STRING) columns.back().offsets.push_back(0);
+    return columns.back();
+}
+
+template <class T> void DatasetIndex::push(const string& name, ColumnType type, T value)
+{
+    std::vector<unsigned char>& data = column(name, type).data;
+    size_t at = data.size();
+    data.resize(at + sizeof(T));
+    std::memcpy(&data[at], &value, sizeof(T));
+}
+
+void DatasetIndex::pushString(const string& name, const string& value)
+{
+    Column& c = column(name, STRING);
+    c.data.insert(c.data.end(), value.begin(), value.end());
+    c.offsets.push_back(c.data.size());
+}
+
+// mean, standard deviation, min and max of the first channels of an image
+void DatasetIndex::pushImage(const string& name, const cv::Mat& image, int channels)
+{
+    std::vector<cv::Mat> planes;
+    cv::split(image, planes);
+    const char* channelNames = "xyzw";
+
+    for (int c = 0; c < channels && c < (int)planes.size(); c++)
+    {
+        string prefix = name + (planes.size() > 1 ? string(".") + channelNames[c] : string()) + ".";
+        cv::Scalar mean, stddev;
+        double min, max;
+        cv::meanStdDev(planes[c], mean, stddev);
+        cv::minMaxLoc(planes[c], &min, &max);
+
+        push(prefix + "mean", FLOAT32, (float)mean[0]);
+        push(prefix + "std", FLOAT32, (float)stddev[0]);
+        push(prefix + "min", FLOAT32, (float)min);
+        push(prefix + "max", FLOAT32, (float)max);
+    }
+}
+
+void DatasetIndex::add(const VolcanoData& vd, const syntheticVolcano::SARGeometry& geometry, float rangeScale,
+                       int geometryIndex, uint32_t shard, uint32_t sample, const string& prefix,
+                       const cv::Mat& gradDEM, const cv::Mat& ref)
+{
+    push("shard", UINT32, shard);
+    push("sample", UINT32, sample);
+    push("geometry", INT32, (int32_t)geometryIndex);
+    pushString("file", prefix);
+
+    push("height", FLOAT32, vd.height);
+    push("craterMaxHeight", FLOAT32, vd.craterMaxHeight);
+    push("craterMinHeight", FLOAT32, vd.craterMinHeight);
+    push("craterMinHeightRatio", FLOAT32, vd.craterMinHeightRatio);
+    push("craterFall", FLOAT32, vd.craterFall);
+    push("craterFallRatio", FLOAT32, vd.craterFallRatio);
+    push("baseLongAxisPixels", UINT32, (uint32_t)vd.baseLongAxisPixels);
+    push("baseShortAxisPixels", UINT32, (uint32_t)vd.baseShortAxisPixels);
+    push("craterLongAxisPixels", UINT32, (uint32_t)vd.craterLongAxisPixels);
+    push("craterShortAxisPixels", UINT32, (uint32_t)vd.craterShortAxisPixels);
+    push("baseCenterX", INT32, (int32_t)vd.baseCenter.x);
+    push("baseCenterY", INT32, (int32_t)vd.baseCenter.y);
+    push("craterCenterX", INT32, (int32_t)vd.craterCenter.x);
+    push("craterCenterY", INT32, (int32_t)vd.craterCenter.y);
+    push("demSeed", UINT32, (uint32_t)vd.demSeed);
+    push("albedoSeed", UINT32, (uint32_t)vd.albedoSeed);
+
+    push("angle2sat", FLOAT32, geometry.angle2sat);
+    push("look", INT32, (int32_t)geometry.look);
+    push("speckleSeed", UINT32, (uint32_t)geometry.speckleSeed);
+    push("rangeScale", FLOAT32, rangeScale);
+
+    push("rows", INT32, (int32_t)ref.rows);
+    push("cols", INT32, (int32_t)ref.cols);
+    pushImage("ProjGradDEM", gradDEM, 2);
+    pushImage("ProjRef", ref, 1);
+
+    rowCount++;
+}
+
+bool DatasetIndex::write(const string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    IndexHeader header;
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = version;
+    header.columns = (uint32_t)columns.size();
+    header.rows = rowCount;
+
+    // columns start after the directory, each 8 byte aligned
+    std::vector<ColumnEntry> directory(columns.size());
+    uint64_t offset = sizeof(header) + directory.size() * sizeof(ColumnEntry);
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        const Column& c = columns[i];
+        ColumnEntry& e = directory[i];
+        std::memset(&e, 0, sizeof(e));
+        std::strncpy(e.name, c.name.c_str(), sizeof(e.name) - 1);
+        e.type = c.type;
+        e.offset = (offset + 7) / 8 * 8;
+        e.bytes = c.offsets.size() * sizeof(uint64_t) + c.data.size();
+        offset = e.offset + e.bytes;
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)directory.data(), directory.size() * sizeof(ColumnEntry));
+    uint64_t at = sizeof(header) + directory.size() * sizeof(ColumnEntry);
+    const char padding[8] = {0};
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        file.write(padding, directory[i].offset - at);
+        file.write((const char*)columns[i].offsets.data(), columns[i].offsets.size() * sizeof(uint64_t));
+        file.write((const char*)columns[i].data.data(), columns[i].data.size());
+        at = directory[i].offset + directory[i].bytes;
+    }
+
+    return (bool)file;
+}
+
+bool DatasetIndex::read(const string& path, const std::vector<string>& names)
+{
+    columns.clear();
+    byName.clear();
+    rowCount = 0;
+
+    std::ifstream file(path, std::ios::binary);
+    IndexHeader header;
+    if (!file.read((char*)&header, sizeof(header)) ||
+        std::memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.version != version)
+    {
+        return false;
+    }
+
+    std::vector<ColumnEntry> directory(header.columns);
+    if (!file.read((char*)directory.data(), directory.size() * sizeof(ColumnEntry))) return false;
+    rowCount = header.rows;
+
+    for (const ColumnEntry& e : directory)
+    {
+        string name(e.name, strnlen(e.name, sizeof(e.name)));
+        if (!names.empty() && std::find(names.begin(), names.end(), name) == names.end()) continue;
+
+        Column c = {name, (ColumnType)e.type, {}, {}};
+        size_t offsetBytes = c.type == STRING ? (rowCount + 1) * sizeof(uint64_t) : 0;
+        if (e.bytes < offsetBytes || (c.type != STRING && e.bytes != rowCount * typeSize(c.type))) return false;
+
+        // only the selected columns are read
+        file.seekg(e.offset);
+        c.offsets.resize(offsetBytes / sizeof(uint64_t));
+        c.data.resize(e.bytes - offsetBytes);
+        if (!file.read((char*)c.offsets.data(), offsetBytes) || !file.read((char*)c.data.data(), c.data.size()))
+        {
+            return false;
+        }
+
+        // text() slices data with the offsets: they must start at 0, never decrease and end at the data size
+        if (c.type == STRING && (c.offsets.front() != 0 || c.offsets.back() != c.data.size() ||
+                                 !std::is_sorted(c.offsets.begin(), c.offsets.end())))
+        {
+            return false;
+        }
+
+        byName[name] = columns.size();
+        columns.push_back(std::move(c));
+    }
+
+    return true;
+}
+
+size_t DatasetIndex::rows() const
+{
+    return rowCount;
+}
+
+std::vector<string> DatasetIndex::columnNames() const
+{
+    std::vector<string> names;
+    for (const Column& c : columns) names.push_back(c.name);
+    return names;
+}
+
+bool DatasetIndex::hasColumn(const string& name) const
+{
+    return byName.count(name) > 0;
+}
+
+const DatasetIndex::Column* DatasetIndex::find(const string& name, ColumnType type) const
+{
+    auto it = byName.find(name);
+    if (it == byName.end() || columns[it->second].type != type) return nullptr;
+    return &columns[it->second];
+}
+
+const int32_t* DatasetIndex::int32Column(const string& name) const
+{
+    const Column* c = find(name, INT32);
+    return c ? (const int32_t*)c->data.data() : nullptr;
+}
+
+const uint32_t* DatasetIndex::uint32Column(const string& name) const
+{
+    const Column* c = find(name, UINT32);
+    return c ? (const uint32_t*)c->data.data() : nullptr;
+}
+
+const float* DatasetIndex::float32Column(const string& name) const
+{
+    const Column* c = find(name, FLOAT32);
+    return c ? (const float*)c->data.data() : nullptr;
+}
+
+string DatasetIndex::text(const string& name, size_t row) const
+{
+    const Column* c = find(name, STRING);
+    if (!c || row + 1 >= c->offsets.size()) return string();
+    return string(c->data.begin() + c->offsets[row], c->data.begin() + c->offsets[row + 1]);
+}
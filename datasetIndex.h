@@ -0,0 +1,68 @@
+#ifndef HEIGHTMAP_DATASETINDEX_H
+#define HEIGHTMAP_DATASETINDEX_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "volcanoDataSet.h"
+#include "volcano.h"
+
+using namespace cv;
+using namespace std;
+
+// Columnar index of a data set, one row per written pair: the VolcanoData and seeds that made it, its viewing
+// geometry, output name and shape and per-channel summaries of both images. A filter reads only the columns it
+// tests instead of opening the images. The file layout is described in the README.
+class DatasetIndex
+{
+public:
+    enum ColumnType : uint32_t
+    {
+        INT32 = 1,
+        UINT32 = 2,
+        FLOAT32 = 3,
+        STRING = 4
+    };
+
+    static const uint32_t version = 1;
+
+    // gradDEM and ref as written (ProjGradDEM and normalized ProjRef), rangeScale their columns per slant range unit
+    void add(const VolcanoData&, const syntheticVolcano::SARGeometry&, float rangeScale, int geometryIndex,
+             uint32_t shard, uint32_t sample, const string& prefix, const cv::Mat& gradDEM, const cv::Mat& ref);
+    bool write(const string& path) const;
+
+    // loads the named columns, all of them when names is empty
+    bool read(const string& path, const std::vector<string>& names = {});
+
+    size_t rows() const;
+    std::vector<string> columnNames() const;
+    bool hasColumn(const string&) const;
+    // nullptr when the column is missing or of another type
+    const int32_t* int32Column(const string&) const;
+    const uint32_t* uint32Column(const string&) const;
+    const float* float32Column(const string&) const;
+    string text(const string&, size_t row) const;
+
+private:
+    struct Column
+    {
+        string name;
+        ColumnType type;
+        std::vector<unsigned char> data;    // rows values, or the string bytes
+        std::vector<uint64_t> offsets;      // strings only: rows + 1 offsets into data
+    };
+
+    std::vector<Column> columns;
+    std::map<string, size_t> byName;
+    size_t rowCount = 0;
+
+    Column& column(const string&, ColumnType);
+    const Column* find(const string&, ColumnType) const;
+    template <class T> void push(const string& name, ColumnType type, T value);
+    void pushString(const string& name, const string& value);
+    void pushImage(const string& name, const cv::Mat&, int channels);
+};
+
+#endif //HEIGHTMAP_DATASETINDEX_H
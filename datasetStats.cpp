@@ -0,0 +1,159 @@
+#include "datasetStats.h"
+#include <fstream>
+
+ChannelStats::ChannelStats(double low, double high, int bins) :
+                           count(0), mean(0), m2(0),
+                           min(std::numeric_limits<double>::max()), max(std::numeric_limits<double>::lowest()),
+                           histLow(low), histHigh(high), histogram(bins > 0 ? bins : 1, 0),
+                           underflow(0), overflow(0), nonFinite(0)
+{
+}
+
+void ChannelStats::add(const float* values, size_t n, int stride)
+{
+    // moments of the chunk first, then one merge: cheaper and more accurate than a Welford step per value. Bins and
+    // counters are incremented in place
+    uint64_t chunkCount = 0;
+    double sum = 0;
+    double chunkMin = std::numeric_limits<double>::max();
+    double chunkMax = std::numeric_limits<double>::lowest();
+    double binScale = histogram.size() / (histHigh - histLow);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = values[i * stride];
+        if (!std::isfinite(v))
+        {
+            nonFinite++;
+            continue;
+        }
+
+        chunkCount++;
+        sum += v;
+        if (v < chunkMin) chunkMin = v;
+        if (v > chunkMax) chunkMax = v;
+
+        if (v < histLow) underflow++;
+        else if (v >= histHigh) overflow++;
+        else histogram[(size_t)((v - histLow) * binScale)]++;
+    }
+
+    if (!chunkCount) return;
+
+    double chunkMean = sum / chunkCount;
+    double chunkM2 = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = values[i * stride];
+        if (std::isfinite(v)) chunkM2 += (v - chunkMean) * (v - chunkMean);
+    }
+
+    mergeMoments(chunkCount, chunkMean, chunkM2, chunkMin, chunkMax);
+}
+
+void ChannelStats::merge(const ChannelStats& other)
+{
+    CV_Assert(other.histogram.size() == histogram.size() && other.histLow == histLow && other.histHigh == histHigh);
+
+    for (size_t b = 0; b < histogram.size(); b++) histogram[b] += other.histogram[b];
+    underflow += other.underflow;
+    overflow += other.overflow;
+    nonFinite += other.nonFinite;
+
+    mergeMoments(other.count, other.mean, other.m2, other.min, other.max);
+}
+
+// parallel variance combination (Chan et al.)
+void ChannelStats::mergeMoments(uint64_t otherCount, double otherMean, double otherM2, double otherMin,
+                                double otherMax)
+{
+    if (otherCount == 0) return;
+    if (otherMin < min) min = otherMin;
+    if (otherMax > max) max = otherMax;
+
+    uint64_t total = count + otherCount;
+    double delta = otherMean - mean;
+    mean += delta * otherCount / total;
+    m2 += otherM2 + delta * delta * ((double)count * otherCount / total);
+    count = total;
+}
+
+uint64_t ChannelStats::getCount() const { return count; }
+double ChannelStats::getMean() const { return mean; }
+double ChannelStats::getVariance() const { return count > 1 ? m2 / (count - 1) : 0; }
+double ChannelStats::getMin() const { return count ? min : 0; }
+double ChannelStats::getMax() const { return count ? max : 0; }
+
+std::ostream& operator<<(std::ostream& os, const ChannelStats& cs)
+{
+    os << "count: "      << cs.getCount()            <<
+          "\nmean: "     << cs.getMean()             <<
+          "\nvariance: " << cs.getVariance()         <<
+          "\nstd: "      << sqrt(cs.getVariance())   <<
+          "\nmin: "      << cs.getMin()              <<
+          "\nmax: "      << cs.getMax()              <<
+          "\nnon finite: " << cs.nonFinite           <<
+          "\nhistogram range: " << cs.histLow << " " << cs.histHigh <<
+          "\nhistogram underflow overflow: " << cs.underflow << " " << cs.overflow <<
+          "\nhistogram:";
+    for (uint64_t c : cs.histogram) os << " " << c;
+    return os << endl;
+}
+//-------------------------------------------------------------------------
+
+void DatasetStats::addOutput(const string& name, int channels, double low, double high, int bins)
+{
+    outputs[name] = std::vector<ChannelStats>(channels, ChannelStats(low, high, bins));
+}
+
+void DatasetStats::add(const string& name, const cv::Mat& mat)
+{
+    std::vector<ChannelStats>& channels = outputs.at(name);
+    CV_Assert(mat.depth() == CV_32F && mat.channels() == (int)channels.size());
+
+    for (int y = 0; y < mat.rows; y++)
+    {
+        const float* row = mat.ptr<float>(y);
+        for (int c = 0; c < mat.channels(); c++)
+        {
+            channels[c].add(row + c, mat.cols, mat.channels());
+        }
+    }
+}
+
+void DatasetStats::merge(const DatasetStats& other)
+{
+    for (const auto& output : other.outputs)
+    {
+        auto it = outputs.find(output.first);
+        if (it == outputs.end())
+        {
+            outputs.insert(output);
+            continue;
+        }
+        CV_Assert(it->second.size() == output.second.size());
+        for (size_t c = 0; c < output.second.size(); c++) it->second[c].merge(output.second[c]);
+    }
+}
+
+const std::vector<ChannelStats>& DatasetStats::getOutput(const string& name) const
+{
+    return outputs.at(name);
+}
+
+bool DatasetStats::write(const string& path) const
+{
+    std::ofstream file(path);
+    if (!file) return false;
+
+    file << setprecision(10);
+    for (const auto& output : outputs)
+    {
+        for (size_t c = 0; c < output.second.size(); c++)
+        {
+            file << "[" << output.first << " channel " << c << "]\n" << output.second[c] << "\n";
+        }
+    }
+
+    return (bool)file;
+}
@@ -0,0 +1,66 @@
+#ifndef HEIGHTMAP_DATASETSTATS_H
+#define HEIGHTMAP_DATASETSTATS_H
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+using namespace cv;
+using namespace std;
+
+// Running statistics of one image channel: count, mean, variance (Welford), min/max and a fixed range histogram.
+// Two accumulators can be merged, so every worker or shard keeps its own and they are combined at the end.
+class ChannelStats
+{
+private:
+    uint64_t count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+
+    double histLow;
+    double histHigh;
+    std::vector<uint64_t> histogram;
+    uint64_t underflow;
+    uint64_t overflow;
+    uint64_t nonFinite;
+
+    void mergeMoments(uint64_t count, double mean, double m2, double min, double max);
+
+public:
+    explicit ChannelStats(double low=0, double high=1, int bins=256);
+
+    // add n values, stride floats apart
+    void add(const float*, size_t n, int stride=1);
+    void merge(const ChannelStats&);
+
+    uint64_t getCount() const;
+    double getMean() const;
+    double getVariance() const;
+    double getMin() const;
+    double getMax() const;
+
+    friend std::ostream& operator<<(std::ostream&, const ChannelStats&);
+};
+
+// Statistics of all named outputs of a data set, one ChannelStats per channel of every output
+class DatasetStats
+{
+private:
+    std::map<string, std::vector<ChannelStats>> outputs;
+
+public:
+    void addOutput(const string&, int channels, double low, double high, int bins=256);
+    void add(const string&, const cv::Mat&);
+    void merge(const DatasetStats&);
+
+    const std::vector<ChannelStats>& getOutput(const string&) const;
+    bool write(const string&) const;
+};
+
+std::ostream& operator<<(std::ostream&, const ChannelStats&);
+
+#endif //HEIGHTMAP_DATASETSTATS_H
@@ -0,0 +1,235 @@
+#include "demCache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+static const char cacheMagic[8] = {'H', 'M', 'D', 'E', 'M', 0, 0, 0};
+
+// FNV-1a, 64 bit
+static void hashBytes(uint64_t& h, const void* data, size_t n)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+template <class T> static void hashValue(uint64_t& h, T value)
+{
+    hashBytes(h, &value, sizeof(T));
+}
+
+DEMCache::DEMCache(const string& _directory, size_t _maxBytes) :
+                   directory(_directory), maxBytes(_maxBytes), hits(0), misses(0), totalBytes(0)
+{
+    mkdir(directory.c_str(), 0755);
+    scan();
+    evict();
+}
+
+uint64_t DEMCache::key(const VolcanoData& vd, unsigned size, int noiseEngine, int coarseFactor)
+{
+    // field by field, so struct padding never reaches the hash
+    uint64_t h = 14695981039346656037ULL;
+    hashValue(h, generatorVersion);
+    // craterMaxHeight, craterMinHeight and craterFall are derived and never read by the renderer
+    hashValue(h, vd.height);
+    hashValue(h, vd.craterMinHeightRatio);
+    hashValue(h, vd.craterFallRatio);
+    hashValue(h, vd.baseLongAxisPixels);
+    hashValue(h, vd.baseShortAxisPixels);
+    hashValue(h, vd.craterLongAxisPixels);
+    hashValue(h, vd.craterShortAxisPixels);
+    hashValue(h, vd.baseCenter.x);
+    hashValue(h, vd.baseCenter.y);
+    hashValue(h, vd.craterCenter.x);
+    hashValue(h, vd.craterCenter.y);
+    hashValue(h, vd.demSeed);
+    hashValue(h, vd.albedoSeed);
+    hashValue(h, size);
+    hashValue(h, noiseEngine);
+    hashValue(h, coarseFactor);
+
+    return h;
+}
+
+string DEMCache::path(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.dem", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+bool DEMCache::load(uint64_t key, cv::Mat& dem, cv::Mat& albedo)
+{
+    string file = path(key);
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        misses++;
+        return false;
+    }
+
+    struct stat st;
+    bool valid = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(DEMCacheHeader);
+    void* mapped = valid ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        misses++;
+        return false;
+    }
+
+    DEMCacheHeader header;
+    std::memcpy(&header, mapped, sizeof(header));
+    size_t plane = (size_t)header.rows * header.cols * sizeof(float);
+    valid = std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+            header.version == generatorVersion && header.key == key &&
+            header.rows > 0 && header.cols > 0 && (header.fields == 1 || header.fields == 2) &&
+            (size_t)st.st_size == sizeof(header) + header.fields * plane;
+
+    if (valid)
+    {
+        // copy out of the mapping, the Mats outlive it
+        float* data = (float*)((char*)mapped + sizeof(header));
+        dem = Mat(header.rows, header.cols, CV_32FC1, data).clone();
+        albedo = header.fields == 2 ? Mat(header.rows, header.cols, CV_32FC1, data + plane / sizeof(float)).clone()
+                                    : Mat();
+
+        // most recently used, the mtime orders the next run's scan
+        utime(file.c_str(), nullptr);
+        touch(key, st.st_size);
+    }
+    munmap(mapped, st.st_size);
+
+    if (valid) hits++;
+    else misses++;
+    return valid;
+}
+
+bool DEMCache::store(uint64_t key, const cv::Mat& dem, const cv::Mat& albedo)
+{
+    CV_Assert(dem.type() == CV_32FC1);
+    CV_Assert(albedo.empty() || (albedo.type() == CV_32FC1 && albedo.size() == dem.size()));
+
+    DEMCacheHeader header;
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = generatorVersion;
+    header.fields = albedo.empty() ? 1 : 2;
+    header.key = key;
+    header.rows = dem.rows;
+    header.cols = dem.cols;
+
+    // write aside and rename, so concurrent readers never see a partial entry
+    string file = path(key);
+    string temp = file + ".tmp" + std::to_string(getpid());
+    FILE* out = fopen(temp.c_str(), "wb");
+    if (!out) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    const cv::Mat* planes[2] = {&dem, &albedo};
+    for (uint32_t p = 0; p < header.fields && ok; p++)
+    {
+        for (int y = 0; y < dem.rows && ok; y++)
+        {
+            ok = fwrite(planes[p]->ptr<float>(y), sizeof(float), dem.cols, out) == (size_t)dem.cols;
+        }
+    }
+    ok = fclose(out) == 0 && ok;
+
+    if (!ok || rename(temp.c_str(), file.c_str()) != 0)
+    {
+        remove(temp.c_str());
+        return false;
+    }
+
+    touch(key, sizeof(header) + header.fields * (size_t)dem.rows * dem.cols * sizeof(float));
+    evict();
+    return true;
+}
+
+// the entries already on disk, oldest mtime first. Equal mtimes (1 s resolution) keep the directory order. Temporary
+// files of store() whose process is gone are left over from a crash and removed
+void DEMCache::scan()
+{
+    struct Found
+    {
+        uint64_t key;
+        time_t used;
+        size_t bytes;
+    };
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+
+    std::vector<Found> found;
+    while (dirent* e = readdir(dir))
+    {
+        string name(e->d_name);
+        char* end = nullptr;
+        unsigned long long key = strtoull(name.c_str(), &end, 16);
+        if (end != name.c_str() + 16 || name.compare(16, 4, ".dem") != 0) continue;
+
+        if (name.compare(20, 4, ".tmp") == 0)
+        {
+            pid_t pid = (pid_t)atol(name.c_str() + 24);
+            if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) remove((directory + "/" + name).c_str());
+            continue;
+        }
+        if (name.size() != 20) continue;
+
+        struct stat st;
+        if (stat((directory + "/" + name).c_str(), &st) != 0) continue;
+        found.push_back({(uint64_t)key, st.st_mtime, (size_t)st.st_size});
+    }
+    closedir(dir);
+
+    std::stable_sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.used < b.used; });
+    for (const Found& f : found) touch(f.key, f.bytes);
+}
+
+// key becomes the most recently used entry
+void DEMCache::touch(uint64_t key, size_t bytes)
+{
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        totalBytes -= it->second.bytes;
+        order.erase(it->second.position);
+        entries.erase(it);
+    }
+
+    order.push_back(key);
+    entries[key] = {bytes, std::prev(order.end())};
+    totalBytes += bytes;
+}
+
+void DEMCache::evict()
+{
+    // the most recently used entry stays, even alone past maxBytes
+    while (totalBytes > maxBytes && order.size() > 1)
+    {
+        uint64_t key = order.front();
+        order.pop_front();
+        totalBytes -= entries[key].bytes;
+        entries.erase(key);
+        remove(path(key).c_str());
+    }
+}
+
+size_t DEMCache::getHits() const { return hits; }
+size_t DEMCache::getMisses() const { return misses; }
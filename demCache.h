@@ -0,0 +1,72 @@
+#ifndef HEIGHTMAP_DEMCACHE_H
+#define HEIGHTMAP_DEMCACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "volcanoDataSet.h"
+
+using namespace cv;
+using namespace std;
+
+// On-disk cache of generated terrain, keyed by everything the DEM and the albedo depend on. Re-running the SAR side
+// (angles, speckle, projection, hole filling) on the same VolcanoData, with its seeds, then skips terrain generation.
+//
+// One file per entry, <key>.dem: a DEMCacheHeader followed by rows x cols float32 DEM values and, if stored,
+// rows x cols float32 albedo values, both row major in host byte order. Entries are read through mmap. When the
+// entries grow past maxBytes the least recently used ones are removed. The directory is scanned once, at
+// construction, ordered by mtime (touched on every hit, so the order carries over to the next run); after that the
+// sizes and the use order are tracked in memory, and the entry just stored is never the one evicted.
+class DEMCache
+{
+public:
+    // bump whenever makeDEM / makeNormals output changes for the same inputs
+    static const uint32_t generatorVersion = 2;
+
+    DEMCache(const string& directory, size_t maxBytes);
+
+    static uint64_t key(const VolcanoData&, unsigned size, int noiseEngine, int coarseFactor);
+
+    // albedo is left empty if the entry was stored without it
+    bool load(uint64_t key, cv::Mat& dem, cv::Mat& albedo);
+    // albedo may be empty
+    bool store(uint64_t key, const cv::Mat& dem, const cv::Mat& albedo);
+
+    size_t getHits() const;
+    size_t getMisses() const;
+
+private:
+    string directory;
+    size_t maxBytes;
+    size_t hits;
+    size_t misses;
+
+    // least recently used first
+    std::list<uint64_t> order;
+    struct Entry
+    {
+        size_t bytes;
+        std::list<uint64_t>::iterator position;
+    };
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t totalBytes;
+
+    string path(uint64_t key) const;
+    void scan();
+    void touch(uint64_t key, size_t bytes);
+    void evict();
+};
+
+struct DEMCacheHeader
+{
+    char magic[8];      // "HMDEM\0\0\0"
+    uint32_t version;   // DEMCache::generatorVersion
+    uint32_t fields;    // 1: DEM, 2: DEM and albedo
+    uint64_t key;
+    int32_t rows;
+    int32_t cols;
+};
+
+#endif //HEIGHTMAP_DEMCACHE_H
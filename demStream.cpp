@@ -0,0 +1,491 @@
+#include "demStream.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DEMRaster::DEMRaster() : data(MAP_FAILED), size(0), rows(0), cols(0), rowsPerStrip(0), hasNodata(false), nodata(0)
+{
+}
+
+DEMRaster::~DEMRaster()
+{
+    close();
+}
+
+void DEMRaster::close()
+{
+    if (data != MAP_FAILED) munmap(data, size);
+    data = MAP_FAILED;
+    size = 0;
+}
+
+bool DEMRaster::map(const string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        size = st.st_size;
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        error = "cannot map " + path;
+        return false;
+    }
+
+    // bands are read front to back
+    madvise(data, size, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool DEMRaster::open(const string& path, int _rows, int _cols)
+{
+    if (!map(path)) return false;
+    hasNodata = false;
+
+    size_t dot = path.find_last_of('.');
+    string extension = dot == string::npos ? "" : path.substr(dot);
+    if (extension == ".tif" || extension == ".tiff" || extension == ".TIF" || extension == ".TIFF")
+    {
+        if (parseTIFF()) return true;
+        close();
+        return false;
+    }
+
+    rows = _rows;
+    cols = _cols;
+    if (rows <= 0 || cols <= 0 || (size_t)rows * cols * sizeof(float) > size)
+    {
+        error = "raw DEM size does not match the file";
+        close();
+        return false;
+    }
+    stripOffsets.assign(1, 0);
+    rowsPerStrip = rows;
+    return true;
+}
+
+// baseline TIFF: one IFD, uncompressed, one float32 sample per pixel, strips. Byte order must be the host's
+bool DEMRaster::parseTIFF()
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint16_t order = 0x4949;    // "II"
+    bool hostLittle = *(const unsigned char*)&order == 0x49;
+
+    if (size < 8 || bytes[0] != bytes[1] || (bytes[0] != 'I' && bytes[0] != 'M'))
+    {
+        error = "not a TIFF file";
+        return false;
+    }
+    if ((bytes[0] == 'I') != hostLittle)
+    {
+        error = "TIFF byte order differs from the host";
+        return false;
+    }
+
+    uint16_t magic;
+    uint32_t ifd;
+    std::memcpy(&magic, bytes + 2, 2);
+    std::memcpy(&ifd, bytes + 4, 4);
+    if (magic != 42 || (size_t)ifd + 2 > size)
+    {
+        error = "unsupported TIFF (BigTIFF or broken header)";
+        return false;
+    }
+
+    uint16_t entries;
+    std::memcpy(&entries, bytes + ifd, 2);
+    if ((size_t)ifd + 2 + entries * 12 > size)
+    {
+        error = "broken TIFF directory";
+        return false;
+    }
+
+    // value i of a SHORT or LONG field, inline when it fits in 4 bytes
+    auto value = [&](const unsigned char* entry, uint32_t i) -> size_t
+    {
+        uint16_t type;
+        uint32_t count, offset;
+        std::memcpy(&type, entry + 2, 2);
+        std::memcpy(&count, entry + 4, 4);
+        std::memcpy(&offset, entry + 8, 4);
+        size_t width = type == 3 ? 2 : 4;
+        const unsigned char* at = count * width <= 4 ? entry + 8 : bytes + offset;
+        if (at + (i + 1) * width > bytes + size) return 0;
+
+        if (width == 2)
+        {
+            uint16_t v;
+            std::memcpy(&v, at + i * 2, 2);
+            return v;
+        }
+        uint32_t v;
+        std::memcpy(&v, at + i * 4, 4);
+        return v;
+    };
+
+    int bits = 0, samples = 1, compression = 1, format = 1, planar = 1;
+    const unsigned char* strips = nullptr;
+    uint32_t stripCount = 0;
+    rows = cols = 0;
+    rowsPerStrip = 0;
+
+    for (int e = 0; e < entries; e++)
+    {
+        const unsigned char* entry = bytes + ifd + 2 + e * 12;
+        uint16_t tag;
+        std::memcpy(&tag, entry, 2);
+
+        switch (tag)
+        {
+            case 256: cols = (int)value(entry, 0); break;
+            case 257: rows = (int)value(entry, 0); break;
+            case 258: bits = (int)value(entry, 0); break;
+            case 259: compression = (int)value(entry, 0); break;
+            case 273: strips = entry; std::memcpy(&stripCount, entry + 4, 4); break;
+            case 277: samples = (int)value(entry, 0); break;
+            case 278: rowsPerStrip = (int)value(entry, 0); break;
+            case 284: planar = (int)value(entry, 0); break;
+            case 322: error = "tiled TIFF is not supported"; return false;
+            case 339: format = (int)value(entry, 0); break;
+            case 42113:
+            {
+                // GDAL_NODATA: ASCII, inline up to 4 bytes
+                uint32_t count, offset;
+                std::memcpy(&count, entry + 4, 4);
+                std::memcpy(&offset, entry + 8, 4);
+                const char* text = count <= 4 ? (const char*)entry + 8 : (const char*)bytes + offset;
+                if (count > 4 && (size_t)offset + count > size) break;
+                string s(text, strnlen(text, count));
+                char* end = nullptr;
+                float v = std::strtof(s.c_str(), &end);
+                if (end != s.c_str())
+                {
+                    hasNodata = true;
+                    nodata = v;
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+
+    if (bits != 32 || format != 3 || samples != 1 || compression != 1 || planar != 1 || !strips)
+    {
+        error = "TIFF must be an uncompressed single band float32 raster in strips";
+        return false;
+    }
+    if (rowsPerStrip <= 0 || rowsPerStrip > rows) rowsPerStrip = rows;
+
+    stripOffsets.resize(stripCount);
+    for (uint32_t s = 0; s < stripCount; s++) stripOffsets[s] = value(strips, s);
+
+    // every row must lie inside the file
+    if (rows <= 0 || cols <= 0 || stripCount < (uint32_t)((rows + rowsPerStrip - 1) / rowsPerStrip) ||
+        rowOffset(rows - 1) + (size_t)cols * sizeof(float) > size)
+    {
+        error = "TIFF strips do not match the raster size";
+        return false;
+    }
+    for (uint32_t s = 0; s + 1 < stripCount; s++)
+    {
+        if (stripOffsets[s] + (size_t)rowsPerStrip * cols * sizeof(float) > size)
+        {
+            error = "TIFF strips do not match the raster size";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t DEMRaster::rowOffset(int y) const
+{
+    return stripOffsets[y / rowsPerStrip] + (size_t)(y % rowsPerStrip) * cols * sizeof(float);
+}
+
+const string& DEMRaster::getError() const { return error; }
+
+void DEMRaster::setNodata(float value)
+{
+    hasNodata = true;
+    nodata = value;
+}
+
+bool DEMRaster::getNodata(float& value) const
+{
+    value = nodata;
+    return hasNodata;
+}
+
+int DEMRaster::getRows() const { return rows; }
+int DEMRaster::getCols() const { return cols; }
+
+void DEMRaster::readRows(int y0, int y1, cv::Mat& out) const
+{
+    CV_Assert(data != MAP_FAILED && 0 <= y0 && y0 <= y1 && y1 <= rows);
+
+    out.create(y1 - y0, cols, CV_32FC1);
+    for (int y = y0; y < y1; y++)
+    {
+        float* row = out.ptr<float>(y - y0);
+        std::memcpy(row, (const char*)data + rowOffset(y), cols * sizeof(float));
+        if (!hasNodata) continue;
+        for (int x = 0; x < cols; x++)
+        {
+            if (row[x] == nodata) row[x] = std::numeric_limits<float>::quiet_NaN();
+        }
+    }
+}
+
+void DEMRaster::prefetch(int y0, int y1) const
+{
+    if (data == MAP_FAILED || y0 >= y1) return;
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t begin = rowOffset(y0) / page * page;
+    size_t end = std::min(size, rowOffset(y1 - 1) + cols * sizeof(float));
+    madvise((char*)data + begin, end - begin, MADV_WILLNEED);
+}
+//-------------------------------------------------------------------------
+
+namespace
+{
+    // DEM rows [y0, y1) of one band in pixel units, with one row of halo on each side where the raster has it
+    struct Band
+    {
+        int y0;
+        int y1;
+        int top;
+        cv::Mat dem;
+    };
+
+    Band loadBand(const DEMRaster& raster, int y0, int y1, int halo, float pixelSpacing)
+    {
+        Band band;
+        band.y0 = y0;
+        band.y1 = y1;
+        band.top = std::max(y0 - halo, 0);
+        raster.readRows(band.top, std::min(y1 + halo, raster.getRows()), band.dem);
+        if (pixelSpacing != 1) band.dem *= 1.0 / pixelSpacing;
+
+        // the band after this one
+        raster.prefetch(std::min(y1 + halo, raster.getRows()), std::min(2 * y1 - y0 + halo, raster.getRows()));
+        return band;
+    }
+
+    struct Outputs
+    {
+        FILE* dem = nullptr;
+        FILE* reflection = nullptr;
+        FILE* layover = nullptr;
+        FILE* shadow = nullptr;
+    };
+
+    bool writeRows(FILE* file, const cv::Mat& m)
+    {
+        size_t rowBytes = m.cols * m.elemSize();
+        for (int y = 0; y < m.rows; y++)
+        {
+            if (fwrite(m.ptr(y), 1, rowBytes, file) != rowBytes) return false;
+        }
+        return true;
+    }
+}
+
+bool streamSAR(const DEMRaster& raster, const string& prefix, const StreamOptions& options, StreamReport& report)
+{
+    int rows = raster.getRows();
+    int cols = raster.getCols();
+    int bandRows = std::max(options.bandRows, 2);
+    cv::Vec3f v2sat = syntheticVolcano::Volcano::lookVector(options.angle2sat, options.look);
+
+    // The row term of the slant range is 0 for every look vector of Volcano::lookVector(), so the band kernels can
+    // work on band relative rows.
+    CV_Assert(v2sat[1] == 0);
+
+    // pass 1: slant range extent
+    cout << "DEM stream: measuring " << rows << " x " << cols << " slant range" << endl;
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    {
+        std::future<Band> next = std::async(std::launch::async, loadBand, std::cref(raster), 0,
+                                            std::min(bandRows, rows), 0, options.pixelSpacing);
+        for (int y0 = 0; y0 < rows; y0 += bandRows)
+        {
+            Band band = next.get();
+            int y1 = std::min(y0 + 2 * bandRows, rows);
+            if (band.y1 < rows)
+            {
+                next = std::async(std::launch::async, loadBand, std::cref(raster), band.y1, y1, 0,
+                                  options.pixelSpacing);
+            }
+
+            kernels::RangeGeometry geometry;
+            kernels::prepareRange(band.dem, false, geometry);
+            kernels::slantRangeRows(band.dem, v2sat, 0, band.dem.rows, geometry);
+            double max;
+            lo = std::min(lo, -kernels::rangeShift(geometry, max));
+            hi = std::max(hi, (float)max);
+        }
+    }
+
+    if (hi == std::numeric_limits<float>::lowest())
+    {
+        cerr << "DEM stream: no valid height in the DEM" << endl;
+        return false;
+    }
+
+    float shift = lo < 0 ? -lo : 0.0f;
+    int width = (int)(hi + shift) + 1;
+    report.rows = rows;
+    report.width = width;
+    report.shift = shift;
+
+    Outputs out;
+    out.dem = fopen((prefix + "_DEM2SAR.raw").c_str(), "wb");
+    out.reflection = fopen((prefix + "_Reflection2SAR.raw").c_str(), "wb");
+    if (options.masks)
+    {
+        out.layover = fopen((prefix + "_Layover2SAR.raw").c_str(), "wb");
+        out.shadow = fopen((prefix + "_Shadow2SAR.raw").c_str(), "wb");
+    }
+
+    bool ok = out.dem && out.reflection && (!options.masks || (out.layover && out.shadow));
+
+    // pass 2: band b projects rows [y0, y0 + look) where look reaches 2 rows into the next band, as hole filling
+    // reads them. The two last filled rows of the previous band sit on top of the fill buffers.
+    cout << "DEM stream: projecting to " << rows << " x " << width << endl;
+    const int lookAhead = 2;
+    cv::Mat prevDEM, prevRef;
+    std::future<bool> written = std::async(std::launch::deferred, [] { return true; });
+    std::future<Band> next = std::async(std::launch::async, loadBand, std::cref(raster), 0,
+                                        std::min(bandRows + lookAhead, rows), 1, options.pixelSpacing);
+
+    for (int b = 0, y0 = 0; ok && y0 < rows; b++, y0 += bandRows)
+    {
+        Band band = next.get();
+        int y1 = std::min(y0 + bandRows, rows);
+        int projected = band.y1 - y0;
+        if (y1 < rows)
+        {
+            next = std::async(std::launch::async, loadBand, std::cref(raster), y1,
+                              std::min(y1 + bandRows + lookAhead, rows), 1, options.pixelSpacing);
+        }
+
+        // normals over the halo, reflection and slant range of the projected rows
+        cv::Mat normals;
+        kernels::normals(band.dem, normals);
+        int first = y0 - band.top;
+        cv::Mat dem = band.dem.rowRange(first, first + projected);
+        cv::Mat n = normals.rowRange(first, first + projected);
+
+        cv::Mat reflection(projected, cols, CV_32FC1);
+        if (options.backscatter)
+        {
+            options.backscatter->rows(v2sat, n, cv::Mat(), reflection, 0, projected);
+        }
+        else
+        {
+            for (int y = 0; y < projected; y++)
+            {
+                const cv::Vec3f* normal = n.ptr<cv::Vec3f>(y);
+                float* ref = reflection.ptr<float>(y);
+                for (int x = 0; x < cols; x++)
+                {
+                    float dot_product = v2sat.dot(normal[x]);
+                    ref[x] = dot_product < 0 ? std::numeric_limits<float>::min() : dot_product;
+                }
+            }
+        }
+
+        // the normals of pixels next to nodata are undefined, they reflect like a slope facing away
+        for (int y = 0; y < projected; y++)
+        {
+            float* ref = reflection.ptr<float>(y);
+            for (int x = 0; x < cols; x++)
+            {
+                if (!std::isfinite(ref[x])) ref[x] = std::numeric_limits<float>::min();
+            }
+        }
+
+        kernels::RangeGeometry geometry;
+        kernels::prepareRange(dem, options.masks, geometry);
+        kernels::slantRangeRows(dem, v2sat, 0, projected, geometry);
+
+        // fill buffers: previous filled rows, then the projected rows
+        int prev = prevDEM.rows;
+        cv::Mat demFill(prev + projected, width, CV_32FC1), refFill(prev + projected, width, CV_32FC1);
+        cv::Mat layover, shadow;
+        if (prev)
+        {
+            cv::Mat demTop = demFill.rowRange(0, prev), refTop = refFill.rowRange(0, prev);
+            prevDEM.copyTo(demTop);
+            prevRef.copyTo(refTop);
+        }
+        cv::Mat demOut = demFill.rowRange(prev, prev + projected);
+        cv::Mat refOut = refFill.rowRange(prev, prev + projected);
+        kernels::prepareProjection(projected, width, demOut, refOut,
+                                   options.masks ? &layover : nullptr, options.masks ? &shadow : nullptr);
+        kernels::projectRows(dem, reflection, geometry, shift, 0, projected, demOut, refOut,
+                             options.masks ? &layover : nullptr, options.masks ? &shadow : nullptr);
+
+        int n0 = prev, n1 = prev + (y1 - y0);
+        kernels::fillHolesRows(demFill, 5, n0, n1);
+        kernels::fillHolesRows(refFill, 5, n0, n1);
+
+        int keep = std::min(2, n1);
+        prevDEM = demFill.rowRange(n1 - keep, n1).clone();
+        prevRef = refFill.rowRange(n1 - keep, n1).clone();
+
+        cv::Mat demBand = demFill.rowRange(n0, n1).clone();
+        cv::Mat refBand = refFill.rowRange(n0, n1).clone();
+        if (options.pixelSpacing != 1) demBand *= options.pixelSpacing;
+        kernels::speckle(refBand, options.speckleSeed + 0x9E3779B9u * (unsigned)b);
+        cv::Mat layBand = options.masks ? layover.rowRange(0, y1 - y0).clone() : cv::Mat();
+        cv::Mat shaBand = options.masks ? shadow.rowRange(0, y1 - y0).clone() : cv::Mat();
+
+        // one write in flight, so bands stay in order
+        ok = written.get();
+        written = std::async(std::launch::async, [=]
+        {
+            return writeRows(out.dem, demBand) && writeRows(out.reflection, refBand) &&
+                   (!out.layover || writeRows(out.layover, layBand)) && (!out.shadow || writeRows(out.shadow, shaBand));
+        });
+    }
+    ok = written.get() && ok;
+
+    for (FILE* f : {out.dem, out.reflection, out.layover, out.shadow})
+    {
+        if (f) ok = fclose(f) == 0 && ok;
+    }
+
+    std::ofstream header(prefix + ".hdr");
+    header << "rows " << rows << "\ncols " << width << "\nshift " << shift <<
+              "\nDEM2SAR float32 " << prefix << "_DEM2SAR.raw" <<
+              "\nReflection2SAR float32 " << prefix << "_Reflection2SAR.raw\n";
+    if (options.masks)
+    {
+        header << "Layover2SAR uint8 " << prefix << "_Layover2SAR.raw" <<
+                  "\nShadow2SAR uint8 " << prefix << "_Shadow2SAR.raw\n";
+    }
+
+    return ok && (bool)header;
+}
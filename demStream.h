@@ -0,0 +1,87 @@
+#ifndef HEIGHTMAP_DEMSTREAM_H
+#define HEIGHTMAP_DEMSTREAM_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "volcano.h"
+
+using namespace cv;
+using namespace std;
+
+// Read only memory mapping of a float32 DEM raster, never loaded as a whole: raw (row major, host byte order, size
+// given by the caller) or an uncompressed single band float32 TIFF / GeoTIFF in host byte order, in strips.
+class DEMRaster
+{
+public:
+    DEMRaster();
+    ~DEMRaster();
+
+    DEMRaster(const DEMRaster&) = delete;
+    DEMRaster& operator=(const DEMRaster&) = delete;
+
+    // .tif / .tiff are parsed as TIFF, anything else is raw and needs rows and cols
+    bool open(const string& path, int rows = 0, int cols = 0);
+    const string& getError() const;
+    // heights equal to the nodata value are read as NaN. Taken from the GDAL_NODATA tag (42113) of a TIFF, or set
+    // here (after open(), it overrides the tag)
+    void setNodata(float);
+    bool getNodata(float&) const;
+
+    int getRows() const;
+    int getCols() const;
+    // copy rows [y0, y1) into out, CV_32FC1 of y1 - y0 rows
+    void readRows(int y0, int y1, cv::Mat& out) const;
+    // let the kernel start reading rows [y0, y1) ahead of readRows()
+    void prefetch(int y0, int y1) const;
+
+private:
+    void* data;
+    size_t size;
+    int rows;
+    int cols;
+    // byte offset of every strip of rowsPerStrip rows, one strip for raw files
+    std::vector<size_t> stripOffsets;
+    int rowsPerStrip;
+    bool hasNodata;
+    float nodata;
+    string error;
+
+    bool map(const string& path);
+    bool parseTIFF();
+    size_t rowOffset(int y) const;
+    void close();
+};
+
+struct StreamOptions
+{
+    float angle2sat = 1.39626;
+    syntheticVolcano::LookDirection look = syntheticVolcano::ASCENDING;
+    unsigned speckleSeed = std::default_random_engine::default_seed;
+    // DEM height units per pixel: heights are divided by it so that slopes and slant ranges are in pixels, and
+    // multiplied back in DEM2SAR
+    float pixelSpacing = 1;
+    int bandRows = 256;
+    bool masks = false;
+    // backscatter model of the reflection, nullptr for cos(incidence)
+    const Backscatter* backscatter = nullptr;
+};
+
+struct StreamReport
+{
+    int rows;
+    int width;
+    float shift;
+};
+
+// Simulates the SAR pair of a DEM too large for memory, in two streaming passes over row bands: the first finds the
+// slant range extent (the projection width), the second computes normals, reflection (uniform albedo, real DEMs have
+// none), projection, hole filling and speckle band by band. The next band is read while the current one is processed
+// and the previous one is written. Memory is a few bands, whatever the size of the DEM.
+//
+// Output: <prefix>_DEM2SAR.raw and <prefix>_Reflection2SAR.raw (float32), <prefix>_Layover2SAR.raw and
+// <prefix>_Shadow2SAR.raw (uint8, with masks), all row major, described by the text header <prefix>.hdr.
+// Hole filling matches the whole image kernel exactly; the speckle is drawn per band as in the banded Volcano.
+bool streamSAR(const DEMRaster&, const string& prefix, const StreamOptions&, StreamReport&);
+
+#endif //HEIGHTMAP_DEMSTREAM_H
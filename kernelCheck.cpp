@@ -0,0 +1,530 @@
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include "kernels.h"
+#include "reference.h"
+#include "noiseEngine.h"
+#include "volcano.h"
+#include "utils.h"
+#include "demStream.h"
+#include "datasetIndex.h"
+
+using namespace cv;
+using namespace std;
+
+// Runs every optimized kernel of kernels.h, for every instruction set this machine supports, and its scalar twin of
+// reference.h on the same seeded random inputs and compares the outputs element by element. Kernels without a
+// reference twin are compared against their generic build. Each noise engine of noiseEngine.h is timed against the
+// original noise field, its batch field compared with its own point by point noise(), and each backscatter table with
+// its model evaluated directly. Finally a Volcano rendered in row bands on the task scheduler is compared with the
+// serial one, a crater edited through Volcano::update() (incremental and tiled) with a Volcano rendered with the
+// edit, a DEM streamed from disk with the whole image projection and hole filling, and the parameter index is
+// written and read back. An element fails when both its absolute error exceeds --abs-tol and its ULP distance exceeds
+// --ulp-tol. The exit code is non zero when any kernel fails.
+//
+// usage: kernelcheck [--seed N] [--sizes 64,257,851] [--abs-tol 1e-4] [--ulp-tol 4] [--mean-tol 1e-5]
+
+struct Tolerance
+{
+    double absTol;
+    int64_t ulpTol;
+    double meanTol;
+};
+
+struct Comparison
+{
+    bool sameShape;
+    double maxAbs;
+    double meanAbs;
+    int64_t maxUlp;
+    size_t failed;
+};
+
+// distance in representable floats, NaNs are infinitely far from everything but another NaN
+static int64_t ulpDistance(float a, float b)
+{
+    if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b) ? 0 : INT64_MAX;
+
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    // map the sign-magnitude bit patterns onto a monotonic integer line
+    int64_t la = ia < 0 ? (int64_t)INT32_MIN - ia : ia;
+    int64_t lb = ib < 0 ? (int64_t)INT32_MIN - ib : ib;
+
+    return la > lb ? la - lb : lb - la;
+}
+
+static Comparison compare(const Mat& ref, const Mat& fast, const Tolerance& tol)
+{
+    Comparison c = {ref.size() == fast.size() && ref.type() == fast.type(), 0, 0, 0, 0};
+    if (!c.sameShape) return c;
+
+    double sum = 0;
+    int n = ref.cols * ref.channels();
+    for (int y = 0; y < ref.rows; y++)
+    {
+        const float* r = ref.ptr<float>(y);
+        const float* f = fast.ptr<float>(y);
+
+        for (int x = 0; x < n; x++)
+        {
+            int64_t ulp = ulpDistance(r[x], f[x]);
+            double err = ulp == 0 ? 0 : std::fabs((double)r[x] - f[x]);
+            if (std::isnan(err)) err = std::numeric_limits<double>::infinity();
+
+            sum += err;
+            c.maxAbs = std::max(c.maxAbs, err);
+            c.maxUlp = std::max(c.maxUlp, ulp);
+            if (err > tol.absTol && ulp > tol.ulpTol) c.failed++;
+        }
+    }
+    c.meanAbs = sum / std::max((size_t)1, (size_t)ref.rows * n);
+
+    return c;
+}
+
+static Mat randomMat(int rows, int cols, float lo, float hi, std::mt19937& generator)
+{
+    std::uniform_real_distribution<float> dis(lo, hi);
+    Mat mat(rows, cols, CV_32FC1);
+    for (int y = 0; y < rows; y++)
+    {
+        float* row = mat.ptr<float>(y);
+        for (int x = 0; x < cols; x++) row[x] = dis(generator);
+    }
+    return mat;
+}
+
+// time f in milliseconds
+template <class F> static double timed(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool report(const string& kernel, int size, const Comparison& c, double refMs, double fastMs,
+                   const Tolerance& tol)
+{
+    bool pass = c.sameShape && c.failed == 0 && c.meanAbs <= tol.meanTol;
+
+    cout << setw(20) << kernel << setw(6) << size;
+    if (!c.sameShape)
+    {
+        cout << "  output shape differs";
+    }
+    else
+    {
+        cout << "  max abs " << setw(12) << c.maxAbs <<
+                "  mean abs " << setw(12) << c.meanAbs <<
+                "  max ulp " << setw(10) << c.maxUlp <<
+                "  failed " << setw(8) << c.failed;
+    }
+    cout << "  ref " << setw(9) << refMs << " ms  fast " << setw(9) << fastMs << " ms  "
+         << (pass ? "PASS" : "FAIL") << endl;
+
+    return pass;
+}
+
+// three octaves of engine.noise() at the coordinates NoiseEngine::field() uses
+static void scalarField(const NoiseEngine& engine, int rows, int cols, Mat& out)
+{
+    out.create(rows, cols, CV_32FC1);
+    for (int y = 0; y < rows; y++)
+    {
+        float n2 = 5*(float)y/(float)rows;
+        for (int x = 0; x < cols; x++)
+        {
+            float n1 = 5*(float)x/(float)cols;
+            out.at<float>(y, x) = engine.noise(n1, n2) + 0.5f*engine.noise(2*n1, 2*n2) + 0.25f*engine.noise(4*n1, 4*n2);
+        }
+    }
+}
+
+static std::vector<int> parseSizes(const string& list)
+{
+    std::vector<int> sizes;
+    std::stringstream ss(list);
+    string item;
+    while (std::getline(ss, item, ',')) sizes.push_back(std::stoi(item));
+    return sizes;
+}
+
+int main (int argc, char** argv)
+{
+    unsigned seed = 12345;
+    std::vector<int> sizes = {64, 257, 851};
+    Tolerance tol = {1e-4, 4, 1e-5};
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg(argv[i]);
+        if (arg == "--seed") seed = std::stoul(argv[i + 1]);
+        else if (arg == "--sizes") sizes = parseSizes(argv[i + 1]);
+        else if (arg == "--abs-tol") tol.absTol = std::stod(argv[i + 1]);
+        else if (arg == "--ulp-tol") tol.ulpTol = std::stoll(argv[i + 1]);
+        else if (arg == "--mean-tol") tol.meanTol = std::stod(argv[i + 1]);
+        else
+        {
+            cerr << "unknown option " << arg << endl;
+            return 2;
+        }
+    }
+
+    cout << setprecision(4);
+    bool pass = true;
+
+    for (int size : sizes)
+    {
+        for (int i = 0; i < kernels::ISA_COUNT; i++)
+        {
+            kernels::KernelISA isa = (kernels::KernelISA)i;
+            if (!kernels::isSupported(isa)) continue;
+
+            const kernels::KernelTable& k = kernels::table(isa);
+            string suffix = string("/") + kernels::isaName(isa);
+            std::mt19937 generator(seed + size);
+            Mat ref, fast, refB, fastB;
+            double refMs, fastMs;
+
+            PerlinNoise pn(seed);
+            refMs = timed([&]{ reference::noiseField(pn, size, size, ref); });
+            fastMs = timed([&]{ k.noiseField(pn, size, size, fast); });
+            pass &= report("noise" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+
+            Mat DEM = randomMat(size, size, 0, 500, generator);
+            refMs = timed([&]{ reference::normals(DEM, ref); });
+            fastMs = timed([&]{ k.normals(DEM, fast); });
+            pass &= report("normals" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+
+            refMs = timed([&]{ ref = reference::gradients(DEM); });
+            fastMs = timed([&]{ k.gradients(DEM, fast); });
+            pass &= report("gradients" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+
+            Mat reflection = randomMat(size, size, 0, 1, generator);
+            Vec3f v2sat(-sin(1.39626f), 0, cos(1.39626f));
+            refMs = timed([&]{ reference::project(DEM, reflection, v2sat, ref, refB); });
+            fastMs = timed([&]{ k.project(DEM, reflection, v2sat, fast, fastB, nullptr, nullptr); });
+            pass &= report("project dem" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+            pass &= report("project ref" + suffix, size, compare(refB, fastB, tol), refMs, fastMs, tol);
+
+            // kernels without a reference twin are checked against their generic build
+            const kernels::KernelTable& generic = kernels::table(kernels::GENERIC);
+            // a fixed scale narrower than the width, so that the far range padding runs too
+            int splatWidth = size / 2 + 1;
+            refMs = timed([&]{ generic.projectSplat(DEM, reflection, v2sat, splatWidth, 0.4f, ref, refB, nullptr,
+                                                    nullptr); });
+            fastMs = timed([&]{ k.projectSplat(DEM, reflection, v2sat, splatWidth, 0.4f, fast, fastB, nullptr,
+                                               nullptr); });
+            pass &= report("splat dem" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+            pass &= report("splat ref" + suffix, size, compare(refB, fastB, tol), refMs, fastMs, tol);
+
+            Mat refLay, refSha, fastLay, fastSha;
+            refMs = timed([&]{ generic.project(DEM, reflection, v2sat, ref, refB, &refLay, &refSha); });
+            fastMs = timed([&]{ k.project(DEM, reflection, v2sat, fast, fastB, &fastLay, &fastSha); });
+            refLay.convertTo(refLay, CV_32F);
+            refSha.convertTo(refSha, CV_32F);
+            fastLay.convertTo(fastLay, CV_32F);
+            fastSha.convertTo(fastSha, CV_32F);
+            pass &= report("layover" + suffix, size, compare(refLay, fastLay, tol), refMs, fastMs, tol);
+            pass &= report("shadow" + suffix, size, compare(refSha, fastSha, tol), refMs, fastMs, tol);
+
+            // roughly a third of the pixels are holes
+            Mat holes = randomMat(size, size, 0, 3, generator);
+            holes.setTo(cv::Scalar(-1), holes < 1);
+            ref = holes.clone();
+            fast = holes.clone();
+            refMs = timed([&]{ reference::fillHoles(ref); });
+            fastMs = timed([&]{ k.fillHoles(fast, 5); });
+            pass &= report("fillHoles" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+
+            ref = reflection.clone();
+            fast = reflection.clone();
+            refMs = timed([&]{ reference::speckle(ref, seed); });
+            fastMs = timed([&]{ k.speckle(fast, seed); });
+            pass &= report("speckle" + suffix, size, compare(ref, fast, tol), refMs, fastMs, tol);
+        }
+
+        // noise engines at the selected instruction set, ref time is the original 3D Perlin field
+        Mat ref, fast, scalar;
+        PerlinNoise pn(seed);
+        double refMs = timed([&]{ reference::noiseField(pn, size, size, ref); });
+        for (int e = 0; e < NOISE_ENGINE_COUNT; e++)
+        {
+            std::unique_ptr<NoiseEngine> engine = makeNoiseEngine((NoiseEngineType)e, seed);
+            double fastMs = timed([&]{ engine->field(size, size, fast); });
+            scalarField(*engine, size, size, scalar);
+            pass &= report(string("engine ") + engine->name(), size, compare(scalar, fast, tol), refMs, fastMs, tol);
+        }
+
+        // backscatter tables against the models evaluated directly, on the normals of a rough random DEM
+        std::mt19937 generator(seed + size);
+        Mat normals, albedo = randomMat(size, size, 0, 1, generator);
+        kernels::normals(randomMat(size, size, 0, 500, generator), normals);
+        Vec3f v2sat = syntheticVolcano::Volcano::lookVector(1.39626, syntheticVolcano::ASCENDING);
+        for (int m = 0; m < BACKSCATTER_MODEL_COUNT; m++)
+        {
+            BackscatterOptions backscatterOptions;
+            backscatterOptions.model = (BackscatterModelType)m;
+            Backscatter backscatter(backscatterOptions);
+
+            ref.create(size, size, CV_32FC1);
+            fast.create(size, size, CV_32FC1);
+            refMs = timed([&]
+            {
+                for (int y = 0; y < size; y++)
+                {
+                    for (int x = 0; x < size; x++)
+                    {
+                        ref.at<float>(y, x) = backscatter.evaluate(v2sat.dot(normals.at<Vec3f>(y, x)),
+                                                                   albedo.at<float>(y, x));
+                    }
+                }
+            });
+            double fastMs = timed([&]{ backscatter.rows(v2sat, normals, albedo, fast, 0, size); });
+            pass &= report(string("backscatter ") + backscatterModelName(backscatterOptions.model), size,
+                           compare(ref, fast, tol), refMs, fastMs, tol);
+        }
+    }
+
+    // Oh et al. (1992) sigma_vv computed by hand for permittivity 5, normalized to normal incidence at ks 1.5:
+    // (incidence, albedo, value) at 20, 40, 60 and 75 degrees
+    {
+        const float cases[4][3] = {{0.9396926f, 1.0f, 0.8375155f}, {0.7660444f, 0.5f, 0.1095953f},
+                                   {0.5f, 0.8f, 0.1189857f}, {0.2588190f, 1.0f, 0.04489356f}};
+        BackscatterOptions backscatterOptions;
+        backscatterOptions.model = SMALL_SLOPE;
+        Backscatter backscatter(backscatterOptions);
+
+        Mat expected(1, 4, CV_32FC1), model(1, 4, CV_32FC1), table(1, 4, CV_32FC1);
+        for (int i = 0; i < 4; i++)
+        {
+            expected.at<float>(0, i) = cases[i][2];
+            model.at<float>(0, i) = backscatter.evaluate(cases[i][0], cases[i][1]);
+            table.at<float>(0, i) = backscatter(cases[i][0], cases[i][1]);
+        }
+        pass &= report("oh model", 4, compare(expected, model, tol), 0, 0, tol);
+        pass &= report("oh table", 4, compare(expected, table, tol), 0, 0, tol);
+    }
+
+    // banded rendering, everything before the speckle must match the serial pipeline
+    {
+        VolcanoData vd = getTestData();
+        vd.demSeed = seed;
+        vd.albedoSeed = seed + 1;
+        syntheticVolcano::VolcanoOptions options;
+        options.masks = true;
+
+        double serialMs, tiledMs;
+        std::unique_ptr<syntheticVolcano::Volcano> serial, tiled;
+        serialMs = timed([&]{ serial.reset(new syntheticVolcano::Volcano(vd, 851, 1.39626, options)); });
+
+        TaskScheduler scheduler;
+        options.scheduler = &scheduler;
+        options.tileRows = 16;
+        tiledMs = timed([&]{ tiled.reset(new syntheticVolcano::Volcano(vd, 851, 1.39626, options)); });
+
+        Mat serialLay, tiledLay;
+        serial->getLayover2SAR().convertTo(serialLay, CV_32F);
+        tiled->getLayover2SAR().convertTo(tiledLay, CV_32F);
+
+        pass &= report("tiled DEM", 851, compare(serial->getDEM(), tiled->getDEM(), tol), serialMs, tiledMs, tol);
+        pass &= report("tiled reflection", 851, compare(serial->getReflection(), tiled->getReflection(), tol),
+                       serialMs, tiledMs, tol);
+        pass &= report("tiled DEM2SAR", 851, compare(serial->getDEM2SAR(), tiled->getDEM2SAR(), tol),
+                       serialMs, tiledMs, tol);
+        pass &= report("tiled layover", 851, compare(serialLay, tiledLay, tol), serialMs, tiledMs, tol);
+    }
+
+    // crater edit through update(), incremental and on the task scheduler: everything must match a volcano rendered
+    // with the new parameters the same way
+    TaskScheduler updateScheduler;
+    for (int tiled = 0; tiled < 2; tiled++)
+    {
+        VolcanoData vd = getTestData();
+        vd.demSeed = seed;
+        vd.albedoSeed = seed + 1;
+        syntheticVolcano::VolcanoOptions options;
+        options.masks = true;
+        options.incremental = !tiled;
+        if (tiled)
+        {
+            options.scheduler = &updateScheduler;
+            options.tileRows = 16;
+        }
+        syntheticVolcano::Volcano edited(vd, 851, 1.39626, options);
+
+        vd.craterFallRatio *= 0.5f;
+        vd.craterMinHeightRatio *= 0.9f;
+        double fullMs, updateMs;
+        std::unique_ptr<syntheticVolcano::Volcano> full;
+        options.incremental = false;
+        fullMs = timed([&]{ full.reset(new syntheticVolcano::Volcano(vd, 851, 1.39626, options)); });
+        bool incremental = false;
+        updateMs = timed([&]{ incremental = edited.update(vd); });
+        cout << "crater update " << (tiled ? "(tiled) " : "") << (incremental ? "incremental" : "rendered again")
+             << endl;
+
+        string name = tiled ? "update tiled " : "update ";
+        pass &= report(name + "DEM", 851, compare(full->getDEM(), edited.getDEM(), tol), fullMs, updateMs, tol);
+        pass &= report(name + "DEM2SAR", 851, compare(full->getDEM2SAR(), edited.getDEM2SAR(), tol),
+                       fullMs, updateMs, tol);
+        pass &= report(name + "Ref2SAR", 851, compare(full->getReflection2SAR(), edited.getReflection2SAR(), tol),
+                       fullMs, updateMs, tol);
+    }
+
+    // streamed DEM, projected and filled band by band, then with NaN and nodata pixels that must become holes
+    for (int withNodata = 0; withNodata < 2; withNodata++)
+    {
+        std::mt19937 generator(seed);
+        Mat DEM = randomMat(257, 300, 0, 50, generator);
+        Mat file = DEM.clone();
+        const float nodata = -32768;
+        if (withNodata)
+        {
+            std::uniform_int_distribution<int> row(0, DEM.rows - 1), col(0, DEM.cols - 1);
+            for (int i = 0; i < 500; i++)
+            {
+                int y = row(generator), x = col(generator);
+                DEM.at<float>(y, x) = std::numeric_limits<float>::quiet_NaN();
+                file.at<float>(y, x) = i % 2 ? nodata : std::numeric_limits<float>::quiet_NaN();
+            }
+            // a whole nodata row
+            for (int x = 0; x < DEM.cols; x++)
+            {
+                DEM.at<float>(100, x) = std::numeric_limits<float>::quiet_NaN();
+                file.at<float>(100, x) = nodata;
+            }
+        }
+
+        string prefix = "kernelcheck_stream";
+        FILE* raw = fopen((prefix + ".raw").c_str(), "wb");
+        for (int y = 0; raw && y < file.rows; y++) fwrite(file.ptr<float>(y), sizeof(float), file.cols, raw);
+        if (raw) fclose(raw);
+
+        Mat ref, refB, fast;
+        double refMs = timed([&]
+        {
+            Vec3f v2sat = syntheticVolcano::Volcano::lookVector(1.39626f, syntheticVolcano::ASCENDING);
+            kernels::project(DEM, DEM, v2sat, ref, refB);
+            kernels::fillHoles(ref);
+        });
+
+        DEMRaster raster;
+        StreamOptions streamOptions;
+        streamOptions.bandRows = 16;
+        StreamReport streamReport = {0, 0, 0};
+        bool streamed = raster.open(prefix + ".raw", DEM.rows, DEM.cols);
+        if (withNodata) raster.setNodata(nodata);
+        double fastMs = timed([&] { streamed = streamed && streamSAR(raster, prefix, streamOptions, streamReport); });
+
+        if (streamed && streamReport.width == ref.cols)
+        {
+            fast.create(DEM.rows, streamReport.width, CV_32FC1);
+            FILE* in = fopen((prefix + "_DEM2SAR.raw").c_str(), "rb");
+            bool complete = in != nullptr;
+            for (int y = 0; complete && y < fast.rows; y++)
+            {
+                complete = fread(fast.ptr<float>(y), sizeof(float), fast.cols, in) == (size_t)fast.cols;
+            }
+            if (in) fclose(in);
+            if (!complete) fast.release();
+        }
+
+        // nodata must not leak into the output
+        size_t nonFinite = 0;
+        for (int y = 0; y < fast.rows; y++)
+        {
+            for (int x = 0; x < fast.cols; x++) nonFinite += !std::isfinite(fast.at<float>(y, x));
+        }
+        if (nonFinite) cout << "stream output has " << nonFinite << " non finite pixels" << endl;
+
+        bool within = report(withNodata ? "stream nodata" : "stream DEM2SAR", DEM.rows, compare(ref, fast, tol),
+                             refMs, fastMs, tol);
+        pass &= within && nonFinite == 0;
+
+        for (string suffix : {".raw", "_DEM2SAR.raw", "_Reflection2SAR.raw", ".hdr"}) remove((prefix + suffix).c_str());
+    }
+
+    // parameter index: written, read back whole and by column, and rejected once a string offset is corrupt
+    {
+        std::mt19937 generator(seed);
+        DatasetIndex index;
+        VolcanoData vd = getTestData();
+        syntheticVolcano::SARGeometry geometry = {1.2f, syntheticVolcano::DESCENDING, 7};
+        const int rows = 3;
+        for (int r = 0; r < rows; r++)
+        {
+            vd.height = 3000 + 100 * r;
+            vd.craterFallRatio = 0.1f + 0.01f * r;
+            Mat gradDEM, ref = randomMat(32, 40, 0, 1, generator);
+            std::vector<Mat> planes = {randomMat(32, 40, -1, 1, generator), randomMat(32, 40, -1, 1, generator),
+                                       Mat(32, 40, CV_32FC1, 0.0)};
+            merge(planes, gradDEM);
+            index.add(vd, geometry, 0.5f, r, 11, r, "sample_" + to_string(r), gradDEM, ref);
+        }
+
+        string path = "kernelcheck_index.hmidx";
+        bool ok = index.write(path);
+
+        DatasetIndex whole;
+        ok = ok && whole.read(path) && whole.rows() == (size_t)rows;
+        const float* height = ok ? whole.float32Column("height") : nullptr;
+        const uint32_t* sample = ok ? whole.uint32Column("sample") : nullptr;
+        const int32_t* look = ok ? whole.int32Column("look") : nullptr;
+        ok = height && sample && look && whole.uint32Column("height") == nullptr &&
+             whole.float32Column("ProjGradDEM.y.mean") != nullptr;
+        for (int r = 0; ok && r < rows; r++)
+        {
+            ok = height[r] == 3000 + 100 * r && sample[r] == (uint32_t)r &&
+                 look[r] == syntheticVolcano::DESCENDING && whole.text("file", r) == "sample_" + to_string(r);
+        }
+
+        DatasetIndex partial;
+        ok = ok && partial.read(path, {"height", "craterFallRatio"}) && partial.columnNames().size() == 2 &&
+             !partial.hasColumn("file") && partial.float32Column("craterFallRatio") != nullptr &&
+             partial.float32Column("craterFallRatio")[rows - 1] == 0.1f + 0.01f * (rows - 1);
+
+        // second offset of the "file" column past the end of its bytes
+        std::vector<char> bytes;
+        if (FILE* in = fopen(path.c_str(), "rb"))
+        {
+            char buffer[4096];
+            for (size_t n; (n = fread(buffer, 1, sizeof(buffer), in)) > 0;)
+                bytes.insert(bytes.end(), buffer, buffer + n);
+            fclose(in);
+        }
+        uint32_t columns = 0;
+        if (bytes.size() >= 24) std::memcpy(&columns, &bytes[12], sizeof(columns));
+        bool corrupted = false;
+        for (uint32_t c = 0; c < columns && 24 + (c + 1) * 64 <= bytes.size(); c++)
+        {
+            const char* entry = &bytes[24 + c * 64];
+            if (strncmp(entry, "file", 48) != 0) continue;
+            uint64_t offset, past = 1ull << 40;
+            std::memcpy(&offset, entry + 56, sizeof(offset));
+            if (offset + 16 > bytes.size()) break;
+            std::memcpy(&bytes[offset + 8], &past, sizeof(past));
+            corrupted = true;
+        }
+        if (FILE* out = fopen(path.c_str(), "wb"))
+        {
+            fwrite(bytes.data(), 1, bytes.size(), out);
+            fclose(out);
+        }
+        DatasetIndex rejected;
+        bool rejects = corrupted && !rejected.read(path);
+        remove(path.c_str());
+
+        cout << setw(20) << "index round trip" << setw(6) << rows << "  "
+             << (ok ? "read back" : "mismatch") << ", corrupt offsets " << (rejects ? "rejected" : "ACCEPTED") << "  "
+             << (ok && rejects ? "PASS" : "FAIL") << endl;
+        pass &= ok && rejects;
+    }
+
+    cout << (pass ? "all kernels within tolerance" : "kernel verification FAILED") << endl;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+
+namespace kernels
+{
+    namespace generic { extern const KernelTable table; }
+#ifdef HEIGHTMAP_X86_DISPATCH
+    namespace sse42 { extern const KernelTable table; }
+    namespace avx2 { extern const KernelTable table; }
+    namespace avx512 { extern const KernelTable table; }
+#endif
+
+    static const char* names[ISA_COUNT] = {"generic", "sse4.2", "avx2", "avx512"};
+
+    const char* isaName(KernelISA isa)
+    {
+        return isa < ISA_COUNT ? names[isa] : "unknown";
+    }
+
+    bool isSupported(KernelISA isa)
+    {
+#ifdef HEIGHTMAP_X86_DISPATCH
+        __builtin_cpu_init();
+        switch (isa)
+        {
+            case GENERIC: return true;
+            case SSE42:   return __builtin_cpu_supports("sse4.2");
+            case AVX2:    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            case AVX512:  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                                 __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+            default:      return false;
+        }
+#else
+        return isa == GENERIC;
+#endif
+    }
+
+    KernelISA bestISA()
+    {
+        for (int isa = ISA_COUNT - 1; isa > GENERIC; isa--)
+        {
+            if (isSupported((KernelISA)isa)) return (KernelISA)isa;
+        }
+        return GENERIC;
+    }
+
+    const KernelTable& table(KernelISA isa)
+    {
+        switch (isa)
+        {
+#ifdef HEIGHTMAP_X86_DISPATCH
+            case SSE42:  return sse42::table;
+            case AVX2:   return avx2::table;
+            case AVX512: return avx512::table;
+#endif
+            default:     return generic::table;
+        }
+    }
+
+    static std::atomic<int> current(-1);
+    static std::mutex selection;
+
+    KernelISA selectISA(const string& name)
+    {
+        KernelISA best = bestISA();
+        KernelISA isa = best;
+        string requestedName = name.empty() && getenv("HEIGHTMAP_ISA") ? getenv("HEIGHTMAP_ISA") : name;
+
+        if (!requestedName.empty())
+        {
+            int requested = ISA_COUNT;
+            for (int i = 0; i < ISA_COUNT; i++) if (requestedName == names[i]) requested = i;
+
+            if (requested < ISA_COUNT && isSupported((KernelISA)requested)) isa = (KernelISA)requested;
+            else cout << "Kernels: " << requestedName << " is not available on this machine" << endl;
+        }
+
+        cout << "Kernels: using " << isaName(isa) << " path (best supported: " << isaName(best) << ")" << endl;
+        current = isa;
+
+        return isa;
+    }
+
+    // the kernels run with, selected from HEIGHTMAP_ISA on first use unless selectISA() was called before
+    static KernelISA selected()
+    {
+        int isa = current.load();
+        if (isa >= 0) return (KernelISA)isa;
+
+        std::lock_guard<std::mutex> lock(selection);
+        if (current.load() < 0) selectISA();
+        return (KernelISA)current.load();
+    }
+
+    KernelISA activeISA()
+    {
+        return selected();
+    }
+
+    void noiseField(const PerlinNoise& pn, int rows, int cols, cv::Mat& out)
+    {
+        table(selected()).noiseField(pn, rows, cols, out);
+    }
+
+    void normals(const cv::Mat& DEM, cv::Mat& Normals)
+    {
+        table(selected()).normals(DEM, Normals);
+    }
+
+    cv::Mat gradients(const cv::Mat& mat)
+    {
+        cv::Mat normal_grad;
+        table(selected()).gradients(mat, normal_grad);
+        return normal_grad;
+    }
+
+    void project(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat,
+                 cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR, cv::Mat* Layover2SAR, cv::Mat* Shadow2SAR)
+    {
+        table(selected()).project(DEM, reflection, v2sat, DEM2SAR, Reflection2SAR, Layover2SAR, Shadow2SAR);
+    }
+
+    void projectSplat(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat, int width, float scale,
+                      cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR, cv::Mat* Layover2SAR, cv::Mat* Shadow2SAR)
+    {
+        table(selected()).projectSplat(DEM, reflection, v2sat, width, scale, DEM2SAR, Reflection2SAR,
+                                       Layover2SAR, Shadow2SAR);
+    }
+
+    void fillHoles(cv::Mat& mat, int kernel_size)
+    {
+        table(selected()).fillHoles(mat, kernel_size);
+    }
+
+    void speckle(cv::Mat& mat, unsigned seed)
+    {
+        table(selected()).speckle(mat, seed);
+    }
+
+    void noiseRows(const PerlinNoise& pn, int rows, int cols, int y0, int y1, cv::Mat& out)
+    {
+        table(selected()).noiseRows(pn, rows, cols, y0, y1, out);
+    }
+
+    void prepareRange(const cv::Mat& DEM, bool masks, RangeGeometry& geometry)
+    {
+        geometry.SlantRange.create(DEM.rows, DEM.cols, CV_32FC1);
+        if (masks)
+        {
+            geometry.layover.create(DEM.rows, DEM.cols, CV_8UC1);
+            geometry.shadow.create(DEM.rows, DEM.cols, CV_8UC1);
+        }
+        else
+        {
+            geometry.layover.release();
+            geometry.shadow.release();
+        }
+        geometry.rowMin.assign(DEM.rows, 0);
+        geometry.rowMax.assign(DEM.rows, 0);
+    }
+
+    void slantRangeRows(const cv::Mat& DEM, const cv::Vec3f& v2sat, int y0, int y1, RangeGeometry& geometry)
+    {
+        table(selected()).slantRangeRows(DEM, v2sat, y0, y1, geometry);
+    }
+
+    float rangeShift(const RangeGeometry& geometry, double& max)
+    {
+        const std::vector<float>& rowMin = geometry.rowMin;
+        const std::vector<float>& rowMax = geometry.rowMax;
+
+        double min = rowMin.empty() ? 0 : *std::min_element(rowMin.begin(), rowMin.end());
+        max = rowMax.empty() ? 0 : *std::max_element(rowMax.begin(), rowMax.end());
+        return min < 0 ? (float)abs(min) : 0.0f;
+    }
+
+    void prepareProjection(int rows, int width, cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR,
+                           cv::Mat* Layover2SAR, cv::Mat* Shadow2SAR)
+    {
+        DEM2SAR.create(rows, width, CV_32FC1);
+        Reflection2SAR.create(rows, width, CV_32FC1);
+        DEM2SAR.setTo(cv::Scalar(-1));
+        Reflection2SAR.setTo(cv::Scalar(-1));
+        for (cv::Mat* mask : {Layover2SAR, Shadow2SAR})
+        {
+            if (!mask) continue;
+            mask->create(rows, width, CV_8UC1);
+            mask->setTo(cv::Scalar(0));
+        }
+    }
+
+    void projectRows(const cv::Mat& DEM, const cv::Mat& reflection, const RangeGeometry& geometry, float shift,
+                     int y0, int y1, cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR, cv::Mat* Layover2SAR,
+                     cv::Mat* Shadow2SAR)
+    {
+        table(selected()).projectRows(DEM, reflection, geometry, shift, y0, y1, DEM2SAR, Reflection2SAR,
+                                      Layover2SAR, Shadow2SAR);
+    }
+
+    void fillHolesRows(cv::Mat& mat, int kernel_size, int y0, int y1)
+    {
+        table(selected()).fillHolesRows(mat, kernel_size, y0, y1);
+    }
+}
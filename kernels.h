@@ -0,0 +1,114 @@
+#ifndef HEIGHTMAP_KERNELS_H
+#define HEIGHTMAP_KERNELS_H
+
+#include <opencv2/opencv.hpp>
+#include <random>
+#include <string>
+#include <vector>
+#include "PerlinNoise.h"
+
+using namespace cv;
+using namespace std;
+
+// Optimized implementations of the per-pixel hot loops of the generator.
+// Kernels that replace original code have a scalar twin in reference.h and must stay within the tolerances checked by
+// kernelCheck.cpp; the other kernels are checked across instruction sets against their generic build.
+//
+// The kernels are compiled once per instruction set (kernelsImpl.h) and the best copy the CPU supports is picked
+// the first time a kernel runs. The choice can be overridden with selectISA() or the HEIGHTMAP_ISA environment
+// variable (generic, sse4.2, avx2, avx512).
+namespace kernels
+{
+    enum KernelISA
+    {
+        GENERIC,
+        SSE42,
+        AVX2,
+        AVX512,
+        ISA_COUNT
+    };
+
+    // slant range of every DEM pixel and its layover / shadow flags (empty without masks), shared by the row band
+    // projection kernels
+    struct RangeGeometry
+    {
+        cv::Mat SlantRange;
+        cv::Mat layover;
+        cv::Mat shadow;
+        std::vector<float> rowMin;
+        std::vector<float> rowMax;
+    };
+
+    struct KernelTable
+    {
+        void (*noiseField)(const PerlinNoise&, int, int, cv::Mat&);
+        void (*normals)(const cv::Mat&, cv::Mat&);
+        void (*gradients)(const cv::Mat&, cv::Mat&);
+        void (*project)(const cv::Mat&, const cv::Mat&, const cv::Vec3f&, cv::Mat&, cv::Mat&, cv::Mat*, cv::Mat*);
+        void (*projectSplat)(const cv::Mat&, const cv::Mat&, const cv::Vec3f&, int, float, cv::Mat&, cv::Mat&,
+                             cv::Mat*, cv::Mat*);
+        void (*fillHoles)(cv::Mat&, int);
+        void (*speckle)(cv::Mat&, unsigned);
+        void (*noiseRows)(const PerlinNoise&, int, int, int, int, cv::Mat&);
+        void (*slantRangeRows)(const cv::Mat&, const cv::Vec3f&, int, int, RangeGeometry&);
+        void (*projectRows)(const cv::Mat&, const cv::Mat&, const RangeGeometry&, float, int, int, cv::Mat&, cv::Mat&,
+                            cv::Mat*, cv::Mat*);
+        void (*fillHolesRows)(cv::Mat&, int, int, int);
+    };
+
+    const char* isaName(KernelISA);
+    // compiled into this binary and supported by the running CPU
+    bool isSupported(KernelISA);
+    KernelISA bestISA();
+    // select the kernels by name and log the choice. "" takes HEIGHTMAP_ISA if it is set, unsupported or missing
+    // names fall back to the best supported set
+    KernelISA selectISA(const string& name="");
+    KernelISA activeISA();
+    // kernels of one instruction set, for comparing them against each other
+    const KernelTable& table(KernelISA);
+
+    // three octave noise of utils.h perlinNoise() evaluated over a rows x cols grid
+    void noiseField(const PerlinNoise&, int rows, int cols, cv::Mat&);
+    // unit surface normals (CV_32FC3) of a DEM, edges replicated
+    void normals(const cv::Mat& DEM, cv::Mat& Normals);
+    // project DEM and reflection to slant range, empty columns are set to -1.
+    // When given, the layover and radar shadow masks (CV_8UC1, 0/255) are computed in the same pass
+    void project(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat,
+                 cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR,
+                 cv::Mat* Layover2SAR=nullptr, cv::Mat* Shadow2SAR=nullptr);
+    // project to a fixed number of columns: column = (slant range + shift) * scale and every pixel is split
+    // bilinearly between its two nearest columns. Ranges past the width are cropped, columns past the far range of
+    // a row repeat its last column, other columns no pixel reaches are set to -1. scale <= 0 stretches the range
+    // extent of this DEM over the width, which makes the range spacing differ between DEMs
+    void projectSplat(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat, int width, float scale,
+                      cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR,
+                      cv::Mat* Layover2SAR=nullptr, cv::Mat* Shadow2SAR=nullptr);
+    // fill the -1 holes left by the projection with a gaussian weighted average of their neighbourhood
+    void fillHoles(cv::Mat&, int kernel_size=5);
+    // add gamma distributed speckle
+    void speckle(cv::Mat&, unsigned seed);
+    // normalized x and y gradients (CV_32FC3, third channel 0), edges replicated
+    cv::Mat gradients(const cv::Mat&);
+
+    // Row band versions of the kernels above, for callers that schedule the bands themselves. Calling them for every
+    // band, in the order given, gives the same output as the whole image kernel.
+    //
+    // rows [y0, y1) of noiseField(), out must already be rows x cols CV_32FC1
+    void noiseRows(const PerlinNoise&, int rows, int cols, int y0, int y1, cv::Mat& out);
+    // project(): prepareRange(), slantRangeRows() for every band, rangeShift(), prepareProjection() with
+    // width = (int)(max + shift) + 1, projectRows() for every band. Non-finite (nodata) heights are left out of the
+    // range extent and not scattered, so they stay holes
+    void prepareRange(const cv::Mat& DEM, bool masks, RangeGeometry&);
+    void slantRangeRows(const cv::Mat& DEM, const cv::Vec3f& v2sat, int y0, int y1, RangeGeometry&);
+    // shift that makes the smallest range 0, max is the largest range
+    float rangeShift(const RangeGeometry&, double& max);
+    void prepareProjection(int rows, int width, cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR,
+                           cv::Mat* Layover2SAR=nullptr, cv::Mat* Shadow2SAR=nullptr);
+    void projectRows(const cv::Mat& DEM, const cv::Mat& reflection, const RangeGeometry&, float shift, int y0, int y1,
+                     cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR,
+                     cv::Mat* Layover2SAR=nullptr, cv::Mat* Shadow2SAR=nullptr);
+    // fillHoles() of rows [y0, y1): rows above y0 must be filled already and rows up to y1 + 2 projected
+    void fillHolesRows(cv::Mat&, int kernel_size, int y0, int y1);
+}
+
+#endif //HEIGHTMAP_KERNELS_H
@@ -0,0 +1,6 @@
+// kernels compiled for avx2, see kernelsImpl.h
+#include "kernels.h"
+
+#pragma GCC target("avx2,fma")
+#define KERNELS_ISA avx2
+#include "kernelsImpl.h"
@@ -0,0 +1,6 @@
+// kernels compiled for avx512, see kernelsImpl.h
+#include "kernels.h"
+
+#pragma GCC target("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")
+#define KERNELS_ISA avx512
+#include "kernelsImpl.h"
@@ -0,0 +1,5 @@
+// kernels compiled for the baseline instruction set of the build, see kernelsImpl.h
+#include "kernels.h"
+
+#define KERNELS_ISA generic
+#include "kernelsImpl.h"
@@ -0,0 +1,460 @@
+// Bodies of the hot kernels. This file is included once by every kernels<ISA>.cpp with KERNELS_ISA naming the
+// namespace of that copy, after a "#pragma GCC target" for its instruction set. kernels.cpp picks one copy at runtime.
+// All library headers are included before the pragma, so inline OpenCV and STL code shared with the rest of the
+// binary is still compiled for the baseline and cannot leak wider instructions into other translation units.
+#ifndef KERNELS_ISA
+#error "define KERNELS_ISA before including kernelsImpl.h"
+#endif
+
+#include "kernels.h"
+
+namespace kernels
+{
+namespace KERNELS_ISA
+{
+    static const float gaussian5[5][5] = {{1,  4,  7,  4, 1},
+                                          {4, 16, 26, 16, 4},
+                                          {7, 26, 41, 26, 7},
+                                          {4, 16, 26, 16, 4},
+                                          {1,  4,  7,  4, 1}};
+
+    static inline void slope(float dzdx, float dzdy, float zSign, float* out)
+    {
+        float inv = 1.0f / std::sqrt(dzdx * dzdx + dzdy * dzdy + 1.0f);
+
+        out[0] = -dzdx * inv;
+        out[1] = -dzdy * inv;
+        out[2] = zSign * inv;
+    }
+
+    // central differences of one row, written as (x, y, z) triplets of out.
+    // z is -1/hyp for surface normals and 0 for gradients
+    static void slopeRow(const float* up, const float* mid, const float* down, float* out, int cols, bool normalZ)
+    {
+        float zSign = normalZ ? -1.0f : 0.0f;
+
+        // branch free interior, so it vectorizes
+        for (int x = 1; x < cols - 1; x++)
+        {
+            slope((mid[x + 1] - mid[x - 1]) * 0.5f, (down[x] - up[x]) * 0.5f, zSign, out + 3 * x);
+        }
+
+        int last = cols - 1;
+        slope((mid[std::min(1, last)] - mid[0]) * 0.5f, (down[0] - up[0]) * 0.5f, zSign, out);
+        if (last > 0) slope((mid[last] - mid[last - 1]) * 0.5f, (down[last] - up[last]) * 0.5f, zSign, out + 3 * last);
+    }
+
+    static void slopes(const cv::Mat& src, cv::Mat& dst, bool normalZ)
+    {
+        dst.create(src.rows, src.cols, CV_32FC3);
+
+        for (int y = 0; y < src.rows; y++)
+        {
+            const float* up = src.ptr<float>(std::max(y - 1, 0));
+            const float* mid = src.ptr<float>(y);
+            const float* down = src.ptr<float>(std::min(y + 1, src.rows - 1));
+
+            slopeRow(up, mid, down, dst.ptr<float>(y), src.cols, normalZ);
+        }
+    }
+
+    // PerlinNoise::noise() on a raw permutation table, so it is compiled with the target flags of this file
+    static inline double fade(double t)
+    {
+        return t * t * t * (t * (t * 6 - 15) + 10);
+    }
+
+    static inline double lerp(double t, double a, double b)
+    {
+        return a + t * (b - a);
+    }
+
+    static inline double grad(int hash, double x, double y, double z)
+    {
+        int h = hash & 15;
+        double u = h < 8 ? x : y,
+               v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+    }
+
+    static inline double perlin(const int* p, double x, double y, double z)
+    {
+        int X = (int) floor(x) & 255;
+        int Y = (int) floor(y) & 255;
+        int Z = (int) floor(z) & 255;
+
+        x -= floor(x);
+        y -= floor(y);
+        z -= floor(z);
+
+        double u = fade(x);
+        double v = fade(y);
+        double w = fade(z);
+
+        int A = p[X] + Y;
+        int AA = p[A] + Z;
+        int AB = p[A + 1] + Z;
+        int B = p[X + 1] + Y;
+        int BA = p[B] + Z;
+        int BB = p[B + 1] + Z;
+
+        double res = lerp(w, lerp(v, lerp(u, grad(p[AA], x, y, z), grad(p[BA], x-1, y, z)),
+                                     lerp(u, grad(p[AB], x, y-1, z), grad(p[BB], x-1, y-1, z))),
+                             lerp(v, lerp(u, grad(p[AA+1], x, y, z-1), grad(p[BA+1], x-1, y, z-1)),
+                                     lerp(u, grad(p[AB+1], x, y-1, z-1), grad(p[BB+1], x-1, y-1, z-1))));
+        return (res + 1.0)/2.0;
+    }
+
+    void noiseRows(const PerlinNoise& pn, int rows, int cols, int y0, int y1, cv::Mat& out)
+    {
+        CV_Assert(out.rows == rows && out.cols == cols && out.type() == CV_32FC1);
+
+        // same coordinates as perlinNoise(), but without copying the permutation vector for every pixel
+        const int* p = pn.permutation().data();
+        float denominatorCols = cols == 0 ? 1.0 : (float)cols;
+        float denominatorRows = rows == 0 ? 1.0 : (float)rows;
+
+        std::vector<float> n1(cols);
+        for (int x = 0; x < cols; x++) n1[x] = 5*(float)x/(denominatorCols);
+
+        for (int y = y0; y < y1; y++)
+        {
+            float n2 = 5*(float)y/(denominatorRows);
+            float* row = out.ptr<float>(y);
+
+            for (int x = 0; x < cols; x++)
+            {
+                row[x] = perlin(p, n1[x], n2, 0.5)
+                         + 0.5 *perlin(p, 2*n1[x], 2*n2, 0.5)
+                         + 0.25*perlin(p, 4*n1[x], 4*n2, 0.5);
+            }
+        }
+    }
+
+    void noiseField(const PerlinNoise& pn, int rows, int cols, cv::Mat& out)
+    {
+        out.create(rows, cols, CV_32FC1);
+        noiseRows(pn, rows, cols, 0, rows, out);
+    }
+
+    void normals(const cv::Mat& DEM, cv::Mat& Normals)
+    {
+        slopes(DEM, Normals, true);
+    }
+
+    void gradients(const cv::Mat& mat, cv::Mat& normal_grad)
+    {
+        slopes(mat, normal_grad, false);
+    }
+
+    // Slant range of rows [y0, y1) of the DEM along the viewing vector, fused with the layover and radar shadow sweep.
+    // Every row is swept once from near to far range keeping the running maximum of the elevation angle term (shadow)
+    // and of the slant distance (layover). Rows are independent.
+    void slantRangeRows(const cv::Mat& DEM, const cv::Vec3f& v2sat, int y0, int y1, RangeGeometry& geometry)
+    {
+        cv::Mat* layover = geometry.layover.empty() ? nullptr : &geometry.layover;
+        cv::Mat* shadow = geometry.shadow.empty() ? nullptr : &geometry.shadow;
+
+        // the satellite lies towards -x when v2sat[0] < 0, near range is then column 0
+        bool fromLeft = v2sat[0] <= 0;
+        float horizontal = std::fabs(v2sat[0]);
+        float vertical = v2sat[2];
+
+        for (int y = y0; y < y1; y++)
+        {
+            const float* dem = DEM.ptr<float>(y);
+            float* range = geometry.SlantRange.ptr<float>(y);
+            uchar* lay = layover ? layover->ptr<uchar>(y) : nullptr;
+            uchar* sha = shadow ? shadow->ptr<uchar>(y) : nullptr;
+            float rowTerm = (float)y * v2sat[1];
+
+            float lo = std::numeric_limits<float>::max();
+            float hi = std::numeric_limits<float>::lowest();
+            float maxElevation = std::numeric_limits<float>::lowest();
+            float maxDistance = std::numeric_limits<float>::lowest();
+
+            for (int i = 0; i < DEM.cols; i++)
+            {
+                int x = fromLeft ? i : DEM.cols - 1 - i;
+                float r = (float)x * v2sat[0] + rowTerm + dem[x] * v2sat[2];
+                range[x] = r;
+
+                // nodata (NaN) heights get a NaN range, they are left out of the extent and of the sweeps
+                if (!std::isfinite(r))
+                {
+                    if (sha) sha[x] = 0;
+                    if (lay) lay[x] = 0;
+                    continue;
+                }
+
+                lo = std::min(lo, r);
+                hi = std::max(hi, r);
+
+                // shadowed: a nearer pixel rises above the line of sight to the satellite
+                // laid over: the pixel appears at a nearer slant range than a pixel in front of it
+                float elevation = dem[x] * horizontal + i * vertical;
+                float distance = i * horizontal - dem[x] * vertical;
+                if (sha) sha[x] = elevation < maxElevation ? 255 : 0;
+                if (lay) lay[x] = distance < maxDistance ? 255 : 0;
+                maxElevation = std::max(maxElevation, elevation);
+                maxDistance = std::max(maxDistance, distance);
+            }
+
+            geometry.rowMin[y] = lo;
+            geometry.rowMax[y] = hi;
+        }
+    }
+
+    // slant range of the whole DEM, rows in parallel. Returns the shift that makes the smallest range 0
+    static float slantRange(const cv::Mat& DEM, const cv::Vec3f& v2sat, RangeGeometry& geometry, double& max,
+                            bool masks)
+    {
+        prepareRange(DEM, masks, geometry);
+        parallel_for_(cv::Range(0, DEM.rows), [&](const cv::Range& rows)
+        {
+            KERNELS_ISA::slantRangeRows(DEM, v2sat, rows.start, rows.end, geometry);
+        });
+
+        return rangeShift(geometry, max);
+    }
+
+    // Columns no pixel reached (demOut == -1) take a mask value only when the nearest reached columns on both sides
+    // carry it, e.g. the stretched back slope inside a shadow
+    static void fillMaskHoles(uchar* mask, const float* demOut, int width, std::vector<uchar>& left)
+    {
+        uchar last = 0;
+        for (int c = 0; c < width; c++)
+        {
+            if (demOut[c] != -1) last = mask[c];
+            left[c] = last;
+        }
+
+        last = 0;
+        for (int c = width - 1; c >= 0; c--)
+        {
+            if (demOut[c] != -1) last = mask[c];
+            else mask[c] = std::min(left[c], last);
+        }
+    }
+
+    // scatter rows [y0, y1) to their slant range columns, the outputs come from prepareProjection()
+    void projectRows(const cv::Mat& DEM, const cv::Mat& reflection, const RangeGeometry& geometry, float shift,
+                     int y0, int y1, cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR, cv::Mat* Layover2SAR,
+                     cv::Mat* Shadow2SAR)
+    {
+        int width = DEM2SAR.cols;
+        std::vector<uchar> left(width);
+
+        for (int y = y0; y < y1; y++)
+        {
+            const float* range = geometry.SlantRange.ptr<float>(y);
+            const float* dem = DEM.ptr<float>(y);
+            const float* ref = reflection.ptr<float>(y);
+            float* demOut = DEM2SAR.ptr<float>(y);
+            float* refOut = Reflection2SAR.ptr<float>(y);
+
+            // pixels without a finite range (nodata) are not scattered, their columns stay holes
+            for (int x = 0; x < DEM.cols; x++)
+            {
+                if (!std::isfinite(range[x])) continue;
+                int xVal = (int)(range[x] + shift);
+                demOut[xVal] = dem[x];
+                refOut[xVal] = ref[x];
+            }
+
+            // a column is masked when any pixel landing on it is
+            if (Layover2SAR)
+            {
+                const uchar* lay = geometry.layover.ptr<uchar>(y);
+                uchar* layOut = Layover2SAR->ptr<uchar>(y);
+                for (int x = 0; x < DEM.cols; x++)
+                {
+                    if (std::isfinite(range[x])) layOut[(int)(range[x] + shift)] |= lay[x];
+                }
+                fillMaskHoles(layOut, demOut, width, left);
+            }
+            if (Shadow2SAR)
+            {
+                const uchar* sha = geometry.shadow.ptr<uchar>(y);
+                uchar* shaOut = Shadow2SAR->ptr<uchar>(y);
+                for (int x = 0; x < DEM.cols; x++)
+                {
+                    if (std::isfinite(range[x])) shaOut[(int)(range[x] + shift)] |= sha[x];
+                }
+                fillMaskHoles(shaOut, demOut, width, left);
+            }
+        }
+    }
+
+    void project(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat,
+                 cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR, cv::Mat* Layover2SAR, cv::Mat* Shadow2SAR)
+    {
+        RangeGeometry geometry;
+        double max;
+        float shift = slantRange(DEM, v2sat, geometry, max, Layover2SAR || Shadow2SAR);
+        int width = (int)((float)max + shift) + 1;
+
+        prepareProjection(DEM.rows, width, DEM2SAR, Reflection2SAR, Layover2SAR, Shadow2SAR);
+        parallel_for_(cv::Range(0, DEM.rows), [&](const cv::Range& rows)
+        {
+            KERNELS_ISA::projectRows(DEM, reflection, geometry, shift, rows.start, rows.end, DEM2SAR, Reflection2SAR,
+                        Layover2SAR, Shadow2SAR);
+        });
+    }
+
+    void projectSplat(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat, int width, float scale,
+                      cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR, cv::Mat* Layover2SAR, cv::Mat* Shadow2SAR)
+    {
+        RangeGeometry geometry;
+        double max;
+        float shift = slantRange(DEM, v2sat, geometry, max, Layover2SAR || Shadow2SAR);
+
+        // without a scale the full range extent of the sample is stretched over the fixed width
+        float extent = (float)max + shift;
+        if (scale <= 0) scale = extent > 0 ? (width - 1) / extent : 0.0f;
+
+        DEM2SAR.create(DEM.rows, width, CV_32FC1);
+        Reflection2SAR.create(DEM.rows, width, CV_32FC1);
+        if (Layover2SAR) Layover2SAR->create(DEM.rows, width, CV_8UC1);
+        if (Shadow2SAR) Shadow2SAR->create(DEM.rows, width, CV_8UC1);
+
+        parallel_for_(cv::Range(0, DEM.rows), [&](const cv::Range& rows)
+        {
+            std::vector<float> weight(width + 1), demSum(width + 1), refSum(width + 1);
+            std::vector<float> laySum(width + 1), shaSum(width + 1);
+            std::vector<uchar> left(width);
+
+            for (int y = rows.start; y < rows.end; y++)
+            {
+                const float* range = geometry.SlantRange.ptr<float>(y);
+                const float* dem = DEM.ptr<float>(y);
+                const float* ref = reflection.ptr<float>(y);
+                const uchar* lay = Layover2SAR ? geometry.layover.ptr<uchar>(y) : nullptr;
+                const uchar* sha = Shadow2SAR ? geometry.shadow.ptr<uchar>(y) : nullptr;
+                for (std::vector<float>* v : {&weight, &demSum, &refSum, &laySum, &shaSum})
+                    std::fill(v->begin(), v->end(), 0.0f);
+
+                // linear splat of every pixel onto its two neighbouring columns, the extra column catches c == width-1
+                for (int x = 0; x < DEM.cols; x++)
+                {
+                    float c = (range[x] + shift) * scale;
+                    // nodata, or past the width (cropped)
+                    if (!std::isfinite(c) || c > width - 1) continue;
+                    int c0 = std::min((int)c, width - 1);
+                    float f = c - c0;
+
+                    weight[c0] += 1 - f;
+                    weight[c0 + 1] += f;
+                    demSum[c0] += (1 - f) * dem[x];
+                    demSum[c0 + 1] += f * dem[x];
+                    refSum[c0] += (1 - f) * ref[x];
+                    refSum[c0 + 1] += f * ref[x];
+                    if (lay && lay[x])
+                    {
+                        laySum[c0] += 1 - f;
+                        laySum[c0 + 1] += f;
+                    }
+                    if (sha && sha[x])
+                    {
+                        shaSum[c0] += 1 - f;
+                        shaSum[c0 + 1] += f;
+                    }
+                }
+
+                float* demOut = DEM2SAR.ptr<float>(y);
+                float* refOut = Reflection2SAR.ptr<float>(y);
+                for (int c = 0; c < width; c++)
+                {
+                    bool empty = weight[c] < 1e-6f;
+                    demOut[c] = empty ? -1 : demSum[c] / weight[c];
+                    refOut[c] = empty ? -1 : refSum[c] / weight[c];
+                }
+
+                // a column is masked when most of its weight comes from masked pixels
+                if (Layover2SAR)
+                {
+                    uchar* layOut = Layover2SAR->ptr<uchar>(y);
+                    for (int c = 0; c < width; c++) layOut[c] = 2 * laySum[c] >= weight[c] && weight[c] > 0 ? 255 : 0;
+                    fillMaskHoles(layOut, demOut, width, left);
+                }
+                if (Shadow2SAR)
+                {
+                    uchar* shaOut = Shadow2SAR->ptr<uchar>(y);
+                    for (int c = 0; c < width; c++) shaOut[c] = 2 * shaSum[c] >= weight[c] && weight[c] > 0 ? 255 : 0;
+                    fillMaskHoles(shaOut, demOut, width, left);
+                }
+
+                // columns past the far range of the row repeat its last one (unmasked) instead of becoming holes
+                int last = width - 1;
+                while (last >= 0 && demOut[last] == -1) last--;
+                for (int c = last + 1; last >= 0 && c < width; c++)
+                {
+                    demOut[c] = demOut[last];
+                    refOut[c] = refOut[last];
+                }
+            }
+        });
+    }
+
+    // holes of rows [y0, y1). Filled values feed the holes after them, so the rows above must be filled already
+    void fillHolesRows(cv::Mat& mat, int kernel_size, int y0, int y1)
+    {
+        CV_Assert(kernel_size > 0 && kernel_size <= 5);
+        int half = kernel_size/2;
+
+        // holes are filled in raster order and filled values feed the holes after them, as in the reference
+        for (int row = y0; row < y1; row++)
+        {
+            float* center = mat.ptr<float>(row);
+            int top = std::max(row - half, 0);
+            int bottom = std::min(row - half + kernel_size, mat.rows);
+
+            for (int col = 0; col < mat.cols; col++)
+            {
+                if (center[col] != -1) continue;
+
+                int x0 = std::max(col - half, 0);
+                int x1 = std::min(col - half + kernel_size, mat.cols);
+                float val = 0, factor = 0;
+
+                for (int y = top; y < bottom; y++)
+                {
+                    const float* src = mat.ptr<float>(y);
+                    const float* weights = gaussian5[y - row + half];
+
+                    for (int x = x0; x < x1; x++)
+                    {
+                        if (std::isnan(src[x])) continue;
+                        val += src[x] * weights[x - col + half];
+                        factor += weights[x - col + half];
+                    }
+                }
+                center[col] = factor == 0 ? 0 : val*(1/factor);
+            }
+        }
+    }
+
+    void fillHoles(cv::Mat& mat, int kernel_size)
+    {
+        fillHolesRows(mat, kernel_size, 0, mat.rows);
+    }
+
+    void speckle(cv::Mat& mat, unsigned seed)
+    {
+        std::default_random_engine generator(seed);
+        std::gamma_distribution<double> distribution(2.0,2.0);
+
+        for (int i = 0; i < mat.rows; i++)
+        {
+            float* row = mat.ptr<float>(i);
+            for (int j = 0; j < mat.cols; j++)
+            {
+                row[j] += distribution(generator);
+            }
+        }
+    }
+
+    extern const KernelTable table = {noiseField, normals, gradients, project, projectSplat, fillHoles, speckle,
+                                      noiseRows, slantRangeRows, projectRows, fillHolesRows};
+}
+}
@@ -0,0 +1,6 @@
+// kernels compiled for sse42, see kernelsImpl.h
+#include "kernels.h"
+
+#pragma GCC target("sse4.2,popcnt")
+#define KERNELS_ISA sse42
+#include "kernelsImpl.h"
@@ -1,20 +1,188 @@
 #include <opencv2/opencv.hpp>
 #include <random>
+#include <sstream>
 #include <time.h>
 #include "volcano.h"
 #include "volcanoDataSet.h"
 #include "utils.h"
+#include "datasetStats.h"
+#include "datasetIndex.h"
+#include "kernels.h"
+#include "demCache.h"
+#include "demStream.h"
 
 using namespace cv;
 using namespace std;
 
+// normalize the reflection, take the DEM gradients and write the pair (and its masks)
+static void writePair(const string& prefix, const syntheticVolcano::SARPair& pair, float rangeScale,
+                      DatasetStats& stats, DatasetIndex& index, const VolcanoData& vd, int geometryIndex,
+                      uint32_t shard, uint32_t sample)
+{
+    Mat demP = pair.DEM2SAR.clone();
+    Mat refP = pair.Reflection2SAR.clone();
+    normalize(refP, refP, 0.0, 1.0, cv::NORM_MINMAX, CV_32FC1);
+
+    Mat demPBG = gradients(demP);
+
+    cv::imwrite(prefix + "_ProjGradDEM.exr", demPBG);
+    cv::imwrite(prefix + "_ProjRef.exr", refP);
+
+    if (!pair.Layover2SAR.empty())
+    {
+        cv::imwrite(prefix + "_ProjLayover.png", pair.Layover2SAR);
+        cv::imwrite(prefix + "_ProjShadow.png", pair.Shadow2SAR);
+    }
+
+    stats.add("ProjGradDEM", demPBG);
+    stats.add("ProjRef", refP);
+    index.add(vd, pair.geometry, rangeScale, geometryIndex, shard, sample, prefix, demPBG, refP);
+}
+
+// angle:look:seed,... with look ascending or descending, e.g. 1.2:descending:7
+static bool parseGeometries(const string& list, std::vector<syntheticVolcano::SARGeometry>& geometries)
+{
+    std::stringstream items(list);
+    string item;
+    while (std::getline(items, item, ','))
+    {
+        syntheticVolcano::SARGeometry g;
+        char look[16];
+        if (sscanf(item.c_str(), "%f:%15[a-z]:%u", &g.angle2sat, look, &g.speckleSeed) != 3) return false;
+        if (string(look) == "ascending") g.look = syntheticVolcano::ASCENDING;
+        else if (string(look) == "descending") g.look = syntheticVolcano::DESCENDING;
+        else return false;
+        geometries.push_back(g);
+    }
+    return true;
+}
+
 int main (int argc, char** argv)
 {
     // measure run time
     clock_t tStart = clock();
 
+    // kernel path override: --isa generic|sse4.2|avx2|avx512 (or HEIGHTMAP_ISA)
+    // fixed output shape:   --shape 512x512
+    // layover/shadow masks: --masks 1
+    // noise engine:         --noise perlin3d|perlin2d|simplex2d|value|texture
+    // coarse DEM grid:      --coarse 4
+    // terrain cache:        --cache dir [--cache-mb 4096], with --seed N to repeat the same volcanoes
+    // banded rendering:     --threads N [--tile-rows 64], 0 threads: one per hardware thread
+    // SAR impulse response: --psf 2x2 [--looks 1] [--window sinc|hamming], range x azimuth resolution in pixels
+    // extra geometries:     --fanout 1.2:descending:7,0.9:ascending:3 (incidence angle:look:speckle seed)
+    // backscatter model:    --backscatter lambert|cosine|muhleman|smallslope [--cos-power 2] [--roughness 1.5]
+    // SAR of a real DEM:    --dem file.tif|file.raw [--dem-size WxH] [--dem-spacing 30] [--band-rows 256] [--dem-out prefix]
+    //                       [--dem-nodata -32768], the TIFF GDAL_NODATA tag otherwise
+    string isa;
+    string cacheDir;
+    size_t cacheMB = 4096;
+    unsigned seed = 0;
+    int threads = -1;
+    string demPath, demOut;
+    int demCols = 0, demRows = 0;
+    bool demNodata = false;
+    float nodata = 0;
+    StreamOptions streamOptions;
+    ImagingOptions imagingOptions;
+    bool imaging = false;
+    BackscatterOptions backscatterOptions;
+    syntheticVolcano::VolcanoOptions options;
+    // extra viewing geometries rendered from every DEM
+    std::vector<syntheticVolcano::SARGeometry> fanOutGeometries;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        string arg(argv[i]);
+        if (arg == "--isa") isa = argv[i + 1];
+        else if (arg == "--masks") options.masks = string(argv[i + 1]) != "0";
+        else if (arg == "--cache") cacheDir = argv[i + 1];
+        else if (arg == "--cache-mb") cacheMB = std::stoul(argv[i + 1]);
+        else if (arg == "--seed") seed = std::stoul(argv[i + 1]);
+        else if (arg == "--threads") threads = std::max(0, atoi(argv[i + 1]));
+        else if (arg == "--tile-rows") options.tileRows = atoi(argv[i + 1]);
+        else if (arg == "--dem") demPath = argv[i + 1];
+        else if (arg == "--dem-out") demOut = argv[i + 1];
+        else if (arg == "--dem-size") sscanf(argv[i + 1], "%dx%d", &demCols, &demRows);
+        else if (arg == "--dem-nodata")
+        {
+            demNodata = true;
+            nodata = std::stof(argv[i + 1]);
+        }
+        else if (arg == "--dem-spacing") streamOptions.pixelSpacing = std::stof(argv[i + 1]);
+        else if (arg == "--band-rows") streamOptions.bandRows = atoi(argv[i + 1]);
+        else if (arg == "--cos-power") backscatterOptions.exponent = std::stof(argv[i + 1]);
+        else if (arg == "--roughness") backscatterOptions.maxRoughness = std::stof(argv[i + 1]);
+        else if (arg == "--backscatter" && backscatterModelFromName(argv[i + 1]) != BACKSCATTER_MODEL_COUNT)
+        {
+            backscatterOptions.model = backscatterModelFromName(argv[i + 1]);
+        }
+        else if (arg == "--looks") imagingOptions.looks = std::max(1, atoi(argv[i + 1]));
+        else if (arg == "--window") imagingOptions.windowAlpha = string(argv[i + 1]) == "hamming" ? 0.54f : 1.0f;
+        else if (arg == "--psf" && sscanf(argv[i + 1], "%fx%f", &imagingOptions.rangeResolution,
+                                          &imagingOptions.azimuthResolution) == 2)
+        {
+            imaging = true;
+        }
+        else if (arg == "--fanout" && !parseGeometries(argv[i + 1], fanOutGeometries))
+        {
+            cerr << "--fanout: expected angle:ascending|descending:seed,..." << endl;
+            return 1;
+        }
+        else if (arg == "--coarse") options.coarseFactor = std::max(1, atoi(argv[i + 1]));
+        else if (arg == "--noise" && noiseEngineFromName(argv[i + 1]) != NOISE_ENGINE_COUNT)
+        {
+            options.noise = noiseEngineFromName(argv[i + 1]);
+        }
+        else if (arg == "--shape" &&
+                 sscanf(argv[i + 1], "%dx%d", &options.outputWidth, &options.outputHeight) == 2)
+        {
+            options.projection = syntheticVolcano::FIXED_SHAPE;
+        }
+    }
+    kernels::selectISA(isa);
+
+    // tabulated once, shared read only by every sample
+    Backscatter backscatter(backscatterOptions);
+    if (backscatterOptions.model != LAMBERT)
+    {
+        options.backscatter = &backscatter;
+        streamOptions.backscatter = &backscatter;
+    }
+
+    // a real DEM is streamed through the SAR stages instead of generating volcanoes
+    if (!demPath.empty())
+    {
+        DEMRaster raster;
+        if (!raster.open(demPath, demRows, demCols))
+        {
+            cerr << "DEM stream: " << raster.getError() << endl;
+            return 1;
+        }
+        if (demNodata) raster.setNodata(nodata);
+
+        streamOptions.masks = options.masks;
+        StreamReport report;
+        bool ok = streamSAR(raster, demOut.empty() ? demPath + ".sar" : demOut, streamOptions, report);
+        cout << "DEM stream: " << report.rows << " x " << report.width << (ok ? " written" : " FAILED") << endl;
+        return ok ? 0 : 1;
+    }
+
+    std::unique_ptr<DEMCache> cache;
+    if (!cacheDir.empty())
+    {
+        cache.reset(new DEMCache(cacheDir, cacheMB << 20));
+        options.cache = cache.get();
+    }
+
+    std::unique_ptr<TaskScheduler> scheduler;
+    if (threads >= 0)
+    {
+        scheduler.reset(new TaskScheduler(threads));
+        options.scheduler = scheduler.get();
+    }
+
     // Random devices
-    std::srand(std::time(nullptr));
+    std::srand(seed ? seed : std::time(nullptr));
     std::random_device rd;
 
     const int numberOfVolcanoes = 251;
@@ -24,11 +192,50 @@ int main (int argc, char** argv)
     //VolcanoData test = getTestData();
     VolcanoData vd = VolcanoData();
 
-    Mat demP, refP, demPBG, refPNG;
-
     string is;
     string path (".//data//dataset-1//");
-    unsigned int randID = std::rand() % 20000;
+    // a fixed --seed repeats the volcanoes, not the output names
+    unsigned int randID = (seed ? (unsigned)std::time(nullptr) : std::rand()) % 20000;
+
+    // global statistics of the written channels, accumulated while generating
+    DatasetStats stats;
+    stats.addOutput("ProjGradDEM", 3, -1, 1);
+    stats.addOutput("ProjRef", 1, 0, 1);
+
+    // parameters, geometry and summaries of every written pair
+    DatasetIndex index;
+
+    // pre-sample all volcano parameters, largest volcanoes first
+    std::mt19937 generator(seed ? seed : rd());
+    VolcanoDataBatch batch;
+    cout << generateVolcanoDataBatch(generator, numberOfVolcanoes, batch);
+
+    // widest range extent of the run: the tallest volcano (plus its noise and shift) at the steepest angle
+    float maxHeight = *std::max_element(batch.height.begin(), batch.height.end()) + 20;
+    float maxExtent = syntheticVolcano::Volcano::rangeExtent(851, 1.39626, maxHeight);
+    for (const syntheticVolcano::SARGeometry& g : fanOutGeometries)
+    {
+        maxExtent = std::max(maxExtent, syntheticVolcano::Volcano::rangeExtent(851, g.angle2sat, maxHeight));
+    }
+
+    // one range scale for the run, so that it fits; native range columns are slant range units
+    if (options.projection == syntheticVolcano::FIXED_SHAPE)
+    {
+        options.rangeScale = (options.outputWidth - 1) / maxExtent;
+        cout << "Range scale: " << options.rangeScale << " columns per slant range unit" << endl;
+    }
+    float rangeScale = options.projection == syntheticVolcano::FIXED_SHAPE ? options.rangeScale : 1;
+
+    // every pair is imaged at one padded size, so the PSF spectrum and the buffers are built once
+    std::unique_ptr<SARImaging> sarImaging;
+    if (imaging)
+    {
+        imagingOptions.maxSize = options.projection == syntheticVolcano::FIXED_SHAPE ?
+                                 Size(options.outputWidth, options.outputHeight) : Size((int)maxExtent + 2, 851);
+        sarImaging.reset(new SARImaging(imagingOptions));
+        options.imaging = sarImaging.get();
+    }
+    std::vector<size_t> order = costOrder(batch);
 
     // data generatin
     for (int i = 0; i < numberOfVolcanoes; i++)
@@ -36,24 +243,25 @@ int main (int argc, char** argv)
         cout << i << endl;
         is = path + to_string(i) + "_" + to_string(randID) + "_";
 
-        std::mt19937 generator(rd());
-        vd = generateVolcanoData(generator);
+        vd = batch.get(order[i]);
 //        imagesSet[i].vd = vd;
 
-        syntheticVolcano::Volcano volcano(vd, 851);
+        syntheticVolcano::Volcano volcano(vd, 851, 1.39626, options);
 
-        demP = volcano.getDEM2SAR().clone();
-        refP = volcano.getReflection2SAR().clone();
-        normalize(refP, refP, 0.0, 1.0, cv::NORM_MINMAX, CV_32FC1);
+        vd = volcano.getVd();
+        syntheticVolcano::SARPair primary;
+        primary.geometry = volcano.getGeometry();
+        primary.DEM2SAR = volcano.getDEM2SAR();
+        primary.Reflection2SAR = volcano.getReflection2SAR();
+        primary.Layover2SAR = volcano.getLayover2SAR();
+        primary.Shadow2SAR = volcano.getShadow2SAR();
+        writePair(is, primary, rangeScale, stats, index, vd, 0, randID, i);
 
-        demPBG = gradients(demP);
-//        refPNG = gradients(refP);
-//        normalize(demPBG, demPBG, 0.0, 1.0, cv::NORM_MINMAX, CV_32FC2);
-//        normalize(refPNG, refPNG, 0.0, 1.0, cv::NORM_MINMAX, CV_32FC2);
-
-        cv::imwrite(is + "_ProjGradDEM.exr", demPBG);
-        //cv::imwrite(is + "_ProjGradRef.exr", refPNG);
-        cv::imwrite(is + "_ProjRef.exr", refP);
+        std::vector<syntheticVolcano::SARPair> pairs = volcano.fanOut(fanOutGeometries);
+        for (size_t k = 0; k < pairs.size(); k++)
+        {
+            writePair(is + "_g" + to_string(k), pairs[k], rangeScale, stats, index, vd, k + 1, randID, i);
+        }
 
         // DO NOT use when generating data. running out of memeory!
 //        imagesSet[i].DEM = volcano.getDEM().clone();
@@ -105,6 +313,10 @@ int main (int argc, char** argv)
 //        cv::imwrite(is + "ReflectionProjected.png", outMat);
 //    }
 
+    stats.write(path + "stats_" + to_string(randID) + ".txt");
+    index.write(path + "index_" + to_string(randID) + ".hmidx");
+    if (cache) cout << "DEM cache: " << cache->getHits() << " hits, " << cache->getMisses() << " misses" << endl;
+
     cout << ("Run time:\n", (double)(clock() - tStart)/CLOCKS_PER_SEC);
 
     return 0;
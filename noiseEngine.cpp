@@ -0,0 +1,366 @@
+#include "noiseEngine.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+static const char* engineNames[NOISE_ENGINE_COUNT] = {"perlin3d", "perlin2d", "simplex2d", "value", "texture"};
+
+// shuffled 0..255 twice, as in PerlinNoise(seed)
+static std::vector<int> permutation(unsigned seed)
+{
+    std::vector<int> p(256);
+    std::iota(p.begin(), p.end(), 0);
+    std::default_random_engine engine(seed);
+    std::shuffle(p.begin(), p.end(), engine);
+    p.insert(p.end(), p.begin(), p.end());
+    return p;
+}
+
+static inline float fade(float t)
+{
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+static inline float lerp(float t, float a, float b)
+{
+    return a + t * (b - a);
+}
+
+static inline int fastFloor(float x)
+{
+    int i = (int)x;
+    return x < i ? i - 1 : i;
+}
+
+void NoiseEngine::noiseRow(const float* xs, float y, float* out, int n) const
+{
+    for (int i = 0; i < n; i++) out[i] = noise(xs[i], y);
+}
+
+void NoiseEngine::field(int rows, int cols, cv::Mat& out) const
+{
+    out.create(rows, cols, CV_32FC1);
+    fieldRows(rows, cols, 0, rows, out);
+}
+
+void NoiseEngine::fieldRows(int rows, int cols, int y0, int y1, cv::Mat& out) const
+{
+    CV_Assert(out.rows == rows && out.cols == cols && out.type() == CV_32FC1);
+
+    float denominatorCols = cols == 0 ? 1.0 : (float)cols;
+    float denominatorRows = rows == 0 ? 1.0 : (float)rows;
+
+    std::vector<float> x1(cols), xs(cols), o(cols);
+    for (int x = 0; x < cols; x++) x1[x] = 5*(float)x/(denominatorCols);
+
+    for (int y = y0; y < y1; y++)
+    {
+        float* row = out.ptr<float>(y);
+        std::fill(row, row + cols, 0.0f);
+        octaveRow(x1, 5*(float)y/(denominatorRows), 0, 3, row, xs, o);
+    }
+}
+
+void NoiseEngine::octaves(int rows, int cols, int first, int last, int outRows, int outCols, float origin, float step,
+                          cv::Mat& out) const
+{
+    out = Mat(outRows, outCols, CV_32FC1, 0.0);
+
+    float denominatorCols = cols == 0 ? 1.0 : (float)cols;
+    float denominatorRows = rows == 0 ? 1.0 : (float)rows;
+
+    std::vector<float> x1(outCols), xs(outCols), o(outCols);
+    for (int x = 0; x < outCols; x++) x1[x] = 5*(origin + x*step)/(denominatorCols);
+
+    for (int y = 0; y < outRows; y++)
+    {
+        octaveRow(x1, 5*(origin + y*step)/(denominatorRows), first, last, out.ptr<float>(y), xs, o);
+    }
+}
+
+void NoiseEngine::octaveRow(const std::vector<float>& x1, float n2, int first, int last, float* row,
+                            std::vector<float>& xs, std::vector<float>& o) const
+{
+    int n = (int)x1.size();
+
+    // octave k: frequency 2^k, amplitude 2^-k
+    for (int k = first; k < last; k++)
+    {
+        float frequency = (float)(1 << k);
+        float amplitude = 1.0f / frequency;
+        for (int x = 0; x < n; x++) xs[x] = frequency*x1[x];
+        noiseRow(xs.data(), frequency*n2, o.data(), n);
+        for (int x = 0; x < n; x++) row[x] += amplitude*o[x];
+    }
+}
+//-------------------------------------------------------------------------
+
+class ImprovedPerlin3D : public NoiseEngine
+{
+private:
+    PerlinNoise pn;
+
+public:
+    explicit ImprovedPerlin3D(unsigned seed) : pn(seed) {}
+
+    float noise(float x, float y) const override { return pn.noise(x, y, 0.5); }
+    // the dispatched kernel, bit identical to the original perlinNoise() loops
+    void fieldRows(int rows, int cols, int y0, int y1, cv::Mat& out) const override
+    {
+        kernels::noiseRows(pn, rows, cols, y0, y1, out);
+    }
+    const char* name() const override { return engineNames[IMPROVED_PERLIN_3D]; }
+};
+//-------------------------------------------------------------------------
+
+class Perlin2D : public NoiseEngine
+{
+protected:
+    std::vector<int> p;
+
+    static inline float grad(int hash, float x, float y)
+    {
+        // 8 directions: the axes and the diagonals
+        switch (hash & 7)
+        {
+            case 0:  return x + y;
+            case 1:  return -x + y;
+            case 2:  return x - y;
+            case 3:  return -x - y;
+            case 4:  return 1.4142135f * x;
+            case 5:  return -1.4142135f * x;
+            case 6:  return 1.4142135f * y;
+            default: return -1.4142135f * y;
+        }
+    }
+
+    // period = 256 wraps like the permutation table; a power of two below it makes the noise tileable
+    inline float eval(float x, float y, int period = 256) const
+    {
+        int xi = fastFloor(x);
+        int yi = fastFloor(y);
+        x -= xi;
+        y -= yi;
+        int mask = period - 1;
+        int X0 = xi & mask, X1 = (xi + 1) & mask;
+        int Y0 = yi & mask, Y1 = (yi + 1) & mask;
+
+        float u = fade(x);
+        float v = fade(y);
+
+        float res = lerp(v, lerp(u, grad(p[p[X0] + Y0], x, y),     grad(p[p[X1] + Y0], x - 1, y)),
+                            lerp(u, grad(p[p[X0] + Y1], x, y - 1), grad(p[p[X1] + Y1], x - 1, y - 1)));
+        return (res + 1.0f) / 2.0f;
+    }
+
+public:
+    explicit Perlin2D(unsigned seed) : p(permutation(seed)) {}
+
+    float noise(float x, float y) const override { return eval(x, y); }
+    void noiseRow(const float* xs, float y, float* out, int n) const override
+    {
+        for (int i = 0; i < n; i++) out[i] = eval(xs[i], y);
+    }
+    // noise repeating every period units, a power of two up to 256
+    float periodic(float x, float y, int period) const { return eval(x, y, period); }
+    const char* name() const override { return engineNames[PERLIN_2D]; }
+};
+//-------------------------------------------------------------------------
+
+class Simplex2D : public NoiseEngine
+{
+private:
+    std::vector<int> p;
+    float gradients[48];
+
+    inline float eval(float x, float y) const
+    {
+        const float F2 = 0.36602540378f;   // (sqrt(3) - 1) / 2
+        const float G2 = 0.21132486540f;   // (3 - sqrt(3)) / 6
+
+        // skew to the simplex lattice and find the containing triangle
+        float s = (x + y) * F2;
+        int i = fastFloor(x + s);
+        int j = fastFloor(y + s);
+        float t = (i + j) * G2;
+        float x0 = x - (i - t);
+        float y0 = y - (j - t);
+        int i1 = x0 > y0 ? 1 : 0;
+        int j1 = 1 - i1;
+
+        float xs[3] = {x0, x0 - i1 + G2, x0 - 1 + 2 * G2};
+        float ys[3] = {y0, y0 - j1 + G2, y0 - 1 + 2 * G2};
+        int hi[3] = {i, i + i1, i + 1};
+        int hj[3] = {j, j + j1, j + 1};
+
+        float res = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            float a = 0.5f - xs[c] * xs[c] - ys[c] * ys[c];
+            if (a <= 0) continue;
+            int g = (p[(hi[c] & 255) + p[hj[c] & 255]] % 24) * 2;
+            a *= a;
+            res += a * a * (gradients[g] * xs[c] + gradients[g + 1] * ys[c]);
+        }
+
+        // unit gradients peak at about 1/99.2
+        res *= 99.2f;
+        return (std::min(std::max(res, -1.0f), 1.0f) + 1.0f) / 2.0f;
+    }
+
+public:
+    explicit Simplex2D(unsigned seed) : p(permutation(seed))
+    {
+        // 24 unit directions, rotated off the axes
+        for (int g = 0; g < 24; g++)
+        {
+            double angle = (g + 0.5) * 2 * M_PI / 24;
+            gradients[2 * g] = (float)cos(angle);
+            gradients[2 * g + 1] = (float)sin(angle);
+        }
+    }
+
+    float noise(float x, float y) const override { return eval(x, y); }
+    void noiseRow(const float* xs, float y, float* out, int n) const override
+    {
+        for (int i = 0; i < n; i++) out[i] = eval(xs[i], y);
+    }
+    const char* name() const override { return engineNames[SIMPLEX_2D]; }
+};
+//-------------------------------------------------------------------------
+
+class ValueNoise : public NoiseEngine
+{
+private:
+    std::vector<int> p;
+    float values[256];
+
+    inline float eval(float x, float y) const
+    {
+        int xi = fastFloor(x);
+        int yi = fastFloor(y);
+        float u = fade(x - xi);
+        float v = fade(y - yi);
+        int X0 = xi & 255, X1 = (xi + 1) & 255;
+        int Y0 = yi & 255, Y1 = (yi + 1) & 255;
+
+        return lerp(v, lerp(u, values[p[p[X0] + Y0]], values[p[p[X1] + Y0]]),
+                       lerp(u, values[p[p[X0] + Y1]], values[p[p[X1] + Y1]]));
+    }
+
+public:
+    explicit ValueNoise(unsigned seed) : p(permutation(seed))
+    {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> dis(0, 1);
+        for (float& v : values) v = dis(generator);
+    }
+
+    float noise(float x, float y) const override { return eval(x, y); }
+    void noiseRow(const float* xs, float y, float* out, int n) const override
+    {
+        for (int i = 0; i < n; i++) out[i] = eval(xs[i], y);
+    }
+    const char* name() const override { return engineNames[VALUE_NOISE]; }
+};
+//-------------------------------------------------------------------------
+
+// One periodic texture per process, built on first use. A seed picks where the field is read from it and in which
+// of its 8 orientations, so every engine only samples
+class NoiseTexture : public NoiseEngine
+{
+private:
+    static const int period = 32;           // noise units covered by the texture
+    static const int texelsPerUnit = 16;
+    static const int size = period * texelsPerUnit;
+    static const unsigned textureSeed = 0x5EED;
+
+    const std::vector<float>& texture;
+    float offsetU, offsetV;
+    bool swap, flipU, flipV;
+
+    static const std::vector<float>& sharedTexture()
+    {
+        // thread safe initialization, the texture is read only afterwards
+        static const std::vector<float> shared = []
+        {
+            Perlin2D perlin(textureSeed);
+            std::vector<float> t(size * size);
+            for (int v = 0; v < size; v++)
+            {
+                for (int u = 0; u < size; u++)
+                {
+                    t[v * size + u] = perlin.periodic((float)u / texelsPerUnit, (float)v / texelsPerUnit, period);
+                }
+            }
+            return t;
+        }();
+        return shared;
+    }
+
+    inline float sample(float x, float y) const
+    {
+        float u = (swap ? y : x) * (flipU ? -texelsPerUnit : texelsPerUnit) + offsetU;
+        float v = (swap ? x : y) * (flipV ? -texelsPerUnit : texelsPerUnit) + offsetV;
+        int u0 = fastFloor(u);
+        int v0 = fastFloor(v);
+        float fu = u - u0;
+        float fv = v - v0;
+
+        const int mask = size - 1;
+        const float* r0 = &texture[(v0 & mask) * size];
+        const float* r1 = &texture[((v0 + 1) & mask) * size];
+        int c0 = u0 & mask, c1 = (u0 + 1) & mask;
+
+        return lerp(fv, lerp(fu, r0[c0], r0[c1]), lerp(fu, r1[c0], r1[c1]));
+    }
+
+public:
+    explicit NoiseTexture(unsigned seed) : texture(sharedTexture())
+    {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> offset(0, size);
+        offsetU = offset(generator);
+        offsetV = offset(generator);
+        unsigned orientation = generator();
+        swap = orientation & 1;
+        flipU = orientation & 2;
+        flipV = orientation & 4;
+    }
+
+    float noise(float x, float y) const override { return sample(x, y); }
+    void noiseRow(const float* xs, float y, float* out, int n) const override
+    {
+        for (int i = 0; i < n; i++) out[i] = sample(xs[i], y);
+    }
+    const char* name() const override { return engineNames[NOISE_TEXTURE]; }
+};
+//-------------------------------------------------------------------------
+
+std::unique_ptr<NoiseEngine> makeNoiseEngine(NoiseEngineType type, unsigned seed)
+{
+    switch (type)
+    {
+        case PERLIN_2D:      return std::unique_ptr<NoiseEngine>(new Perlin2D(seed));
+        case SIMPLEX_2D:     return std::unique_ptr<NoiseEngine>(new Simplex2D(seed));
+        case VALUE_NOISE:    return std::unique_ptr<NoiseEngine>(new ValueNoise(seed));
+        case NOISE_TEXTURE:  return std::unique_ptr<NoiseEngine>(new NoiseTexture(seed));
+        default:             return std::unique_ptr<NoiseEngine>(new ImprovedPerlin3D(seed));
+    }
+}
+
+const char* noiseEngineName(NoiseEngineType type)
+{
+    return type < NOISE_ENGINE_COUNT ? engineNames[type] : "unknown";
+}
+
+NoiseEngineType noiseEngineFromName(const string& name)
+{
+    for (int i = 0; i < NOISE_ENGINE_COUNT; i++)
+    {
+        if (name == engineNames[i]) return (NoiseEngineType)i;
+    }
+    return NOISE_ENGINE_COUNT;
+}
@@ -0,0 +1,56 @@
+#ifndef HEIGHTMAP_NOISEENGINE_H
+#define HEIGHTMAP_NOISEENGINE_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "PerlinNoise.h"
+
+using namespace cv;
+using namespace std;
+
+// Noise sources for terrain detail and albedo, from the most realistic to the cheapest
+enum NoiseEngineType
+{
+    IMPROVED_PERLIN_3D,   // PerlinNoise sampled at z = 0.5, the original generator
+    PERLIN_2D,            // gradient noise on a 2D lattice, a quarter of the corner work of the 3D version
+    SIMPLEX_2D,           // classic 2D simplex noise: 3 corners, r^2 = 0.5 kernel, 24 gradient directions, fewer axis
+                          // aligned artefacts
+    VALUE_NOISE,          // interpolated random lattice values, blockier
+    NOISE_TEXTURE,        // periodic 2D Perlin texture built once per run, sampled bilinearly at a per seed offset
+                          // and orientation, repeats every 32 units
+    NOISE_ENGINE_COUNT
+};
+
+// 2D noise in about [0, 1]
+class NoiseEngine
+{
+public:
+    virtual ~NoiseEngine() = default;
+
+    virtual float noise(float x, float y) const = 0;
+    // batch API: out[i] = noise(xs[i], y)
+    virtual void noiseRow(const float* xs, float y, float* out, int n) const;
+    // three octaves over a rows x cols grid, with the coordinates of utils.h perlinNoise()
+    void field(int rows, int cols, cv::Mat& out) const;
+    // rows [y0, y1) of field(), out must already be rows x cols CV_32FC1
+    virtual void fieldRows(int rows, int cols, int y0, int y1, cv::Mat& out) const;
+    // octaves [first, last) of field(rows, cols) on an outRows x outCols grid whose pixel (i, j) sits at field
+    // position (origin + i * step, origin + j * step)
+    void octaves(int rows, int cols, int first, int last, int outRows, int outCols, float origin, float step,
+                 cv::Mat& out) const;
+    virtual const char* name() const = 0;
+
+private:
+    // octaves [first, last) at (x1[i], n2), added to row
+    void octaveRow(const std::vector<float>& x1, float n2, int first, int last, float* row,
+                   std::vector<float>& xs, std::vector<float>& o) const;
+};
+
+std::unique_ptr<NoiseEngine> makeNoiseEngine(NoiseEngineType, unsigned seed);
+const char* noiseEngineName(NoiseEngineType);
+// NOISE_ENGINE_COUNT for unknown names
+NoiseEngineType noiseEngineFromName(const string&);
+
+#endif //HEIGHTMAP_NOISEENGINE_H
@@ -0,0 +1,159 @@
+#include "reference.h"
+
+namespace reference
+{
+    static float clampedAt(const cv::Mat& mat, int y, int x)
+    {
+        y = std::min(std::max(y, 0), mat.rows - 1);
+        x = std::min(std::max(x, 0), mat.cols - 1);
+        return mat.at<float>(y, x);
+    }
+
+    void noiseField(const PerlinNoise& pn, int rows, int cols, cv::Mat& out)
+    {
+        out = Mat(rows, cols, CV_32FC1, 0.0);
+
+        for (int y = 0; y < rows; y++)
+        {
+            for (int x = 0; x < cols; x++)
+            {
+                out.at<float>(y, x) = perlinNoise(Point(x, y), rows, cols, pn);
+            }
+        }
+    }
+
+    void normals(const cv::Mat& DEM, cv::Mat& Normals)
+    {
+        Normals = Mat(DEM.rows, DEM.cols, CV_32FC3, 0.0);
+
+        for (int y = 0; y < DEM.rows; y++)
+        {
+            for (int x = 0; x < DEM.cols; x++)
+            {
+                float dzdx = (clampedAt(DEM, y, x + 1) - clampedAt(DEM, y, x - 1)) / 2.0;
+                float dzdy = (clampedAt(DEM, y + 1, x) - clampedAt(DEM, y - 1, x)) / 2.0;
+
+                float hyp = sqrt(pow(dzdx, 2) + pow(dzdy, 2) + 1);
+                dzdx /= hyp;
+                dzdy /= hyp;
+                Vec3f norm(-dzdx, -dzdy, -1.0f/hyp);
+
+                Normals.at<cv::Vec3f>(y, x) = norm;
+            }
+        }
+    }
+
+    void project(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat,
+                 cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR)
+    {
+        Mat Range = Mat(DEM.rows, DEM.cols, CV_32FC1, 0.0);
+
+        for (int y = 0; y < DEM.rows; y++)
+        {
+            for (int x = 0; x < DEM.cols; x++)
+            {
+                Vec3f demP =  Vec3f(x, y, DEM.at<float>(y, x));
+                Range.at<float>(y, x) = demP.dot(v2sat);
+            }
+        }
+
+        double min, max;
+        minMaxLoc(Range, &min, &max);
+        if(min < 0)
+        {
+            Range += abs(min);
+            minMaxLoc(Range, &min, &max);
+        }
+
+        // the farthest pixel lands on column (int)max, the original (int)max wide output wrote it past the row
+        DEM2SAR = Mat(DEM.rows, (int)max + 1, CV_32FC1, cv::Scalar(-1));
+        Reflection2SAR = Mat(DEM.rows, (int)max + 1, CV_32FC1, cv::Scalar(-1));
+
+        int xVal;
+        for (int y = 0; y < DEM.rows; y++)
+        {
+            for (int x = 0; x < DEM.cols; x++)
+            {
+                xVal = Range.at<float>(y, x);
+                DEM2SAR.at<float>(y, xVal) = DEM.at<float>(y, x);
+                Reflection2SAR.at<float>(y, xVal) = reflection.at<float>(y, x);
+            }
+        }
+    }
+
+    void fillHoles(cv::Mat &mat, int kernel_size)
+    {
+        float factor = 0, val=0;
+
+        cv::Mat kernel(5, 5, CV_32FC1, cv::Scalar(-1));
+        kernel.at<float>(0,0)=1; kernel.at<float>(0,1)=4;  kernel.at<float>(0,2)=7;  kernel.at<float>(0,3)=4;  kernel.at<float>(0,4)=1;
+        kernel.at<float>(1,0)=4; kernel.at<float>(1,1)=16; kernel.at<float>(1,2)=26; kernel.at<float>(1,3)=16; kernel.at<float>(1,4)=4;
+        kernel.at<float>(2,0)=7; kernel.at<float>(2,1)=26; kernel.at<float>(2,2)=41; kernel.at<float>(2,3)=26; kernel.at<float>(2,4)=7;
+        kernel.at<float>(3,0)=4; kernel.at<float>(3,1)=16; kernel.at<float>(3,2)=26; kernel.at<float>(3,3)=16; kernel.at<float>(3,4)=4;
+        kernel.at<float>(4,0)=1; kernel.at<float>(4,1)=4;  kernel.at<float>(4,2)=7;  kernel.at<float>(4,3)=4;  kernel.at<float>(4,4)=1;
+
+        for (int row=0; row<mat.rows; row++)
+        {
+            for (int col=0; col<mat.cols; col++)
+            {
+                if(mat.at<float>(row,col) != -1) continue;
+
+                for (int ker_row=0; ker_row<kernel_size; ker_row++)
+                {
+                    for (int ker_col = 0; ker_col<kernel_size; ker_col++)
+                    {
+                        int kernel2mat_y = row-kernel_size/2+ker_row;
+                        int kernel2mat_x = col-kernel_size/2+ker_col;
+
+                        // >= : the original > read one row / column past the image
+                        if(kernel2mat_y < 0 || kernel2mat_y >= mat.rows || kernel2mat_x < 0 || kernel2mat_x >= mat.cols) continue;
+
+                        if(isnan(mat.at<float>(kernel2mat_y, kernel2mat_x))) continue;
+                        val += mat.at<float>(kernel2mat_y, kernel2mat_x) * kernel.at<float>(ker_row, ker_col);
+                        factor += kernel.at<float>(ker_row, ker_col);
+                    }
+                }
+                mat.at<float>(row, col) = factor == 0 ? 0 : val*(1/factor);
+                val=0;
+                factor = 0;
+            }
+        }
+    }
+
+    void speckle(cv::Mat& mat, unsigned seed)
+    {
+        std::default_random_engine generator(seed);
+        std::gamma_distribution<double> distribution(2.0,2.0);
+
+        for(int i = 0; i < mat.rows; i++)
+        {
+            for(int j = 0; j < mat.cols; j++)
+            {
+                mat.at<float>(i, j) += distribution(generator);
+            }
+        }
+    }
+
+    cv::Mat gradients(const cv::Mat &mat)
+    {
+        cv::Mat normal_grad = Mat(mat.rows, mat.cols, CV_32FC3, 0.0);
+
+        for (int y = 0; y < mat.rows; y++)
+        {
+            for (int x = 0; x < mat.cols; x++)
+            {
+                float dzdx = (clampedAt(mat, y, x + 1) - clampedAt(mat, y, x - 1)) / 2.0;
+                float dzdy = (clampedAt(mat, y + 1, x) - clampedAt(mat, y - 1, x)) / 2.0;
+
+                float hyp = sqrt(pow(dzdx, 2) + pow(dzdy, 2) + 1);
+                dzdx /= hyp;
+                dzdy /= hyp;
+                Vec3f norm(-dzdx, -dzdy, 0);
+
+                normal_grad.at<cv::Vec3f>(y, x) = norm;
+            }
+        }
+
+        return normal_grad;
+    }
+}
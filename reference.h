@@ -0,0 +1,31 @@
+#ifndef HEIGHTMAP_REFERENCE_H
+#define HEIGHTMAP_REFERENCE_H
+
+#include <opencv2/opencv.hpp>
+#include "PerlinNoise.h"
+#include "utils.h"
+
+using namespace cv;
+using namespace std;
+
+// The original scalar implementations of the hot kernels, kept as the ground truth that every optimized kernel in
+// kernels.h is verified against (see kernelCheck.cpp). They differ from the original code only where it read or wrote
+// outside the image, so that the results are deterministic:
+// - normals, gradients: neighbours beyond the image border are clamped to the edge (normals are the loop that
+//   Volcano::makeReflection() used to compute them in, split out)
+// - project: the output is (int)max + 1 columns wide; the original allocated (int)max columns and wrote the farthest
+//   pixels one column past the end of the row
+// - fillHoles (extrapolate_mat): neighbours are skipped from row / col == rows / cols on (>=); the original tested >
+//   and read one row and one column past the image
+namespace reference
+{
+    void noiseField(const PerlinNoise&, int rows, int cols, cv::Mat&);
+    void normals(const cv::Mat& DEM, cv::Mat& Normals);
+    void project(const cv::Mat& DEM, const cv::Mat& reflection, const cv::Vec3f& v2sat,
+                 cv::Mat& DEM2SAR, cv::Mat& Reflection2SAR);
+    void fillHoles(cv::Mat&, int kernel_size=5);
+    void speckle(cv::Mat&, unsigned seed);
+    cv::Mat gradients(const cv::Mat&);
+}
+
+#endif //HEIGHTMAP_REFERENCE_H
@@ -0,0 +1,105 @@
+#include "sarImaging.h"
+#include <cmath>
+
+SARImaging::SARImaging(const ImagingOptions& _options) : options(_options), border(0), gain(1)
+{
+    options.looks = std::max(options.looks, 1);
+}
+
+// Frequency response of one axis: the band of a sinc with the given -3 dB width (0.886 / resolution cycles per
+// pixel), raised cosine weighted by alpha. Index k of an n point DFT is the frequency min(k, n - k) / n.
+void SARImaging::window(int n, float resolution, float alpha, std::vector<float>& w)
+{
+    float band = std::min(0.886f / std::max(resolution, 0.886f), 1.0f);
+    w.resize(n);
+    for (int k = 0; k < n; k++)
+    {
+        float f = (float)std::min(k, n - k) / n;
+        w[k] = 2 * f <= band ? alpha + (1 - alpha) * std::cos(2 * (float)M_PI * f / band) : 0.0f;
+    }
+}
+
+void SARImaging::prepare(Size size)
+{
+    if (size == imageSize) return;
+    imageSize = size;
+
+    // the main lobe and the first side lobes must not wrap around
+    border = (int)std::ceil(4 * std::max(options.rangeResolution, options.azimuthResolution));
+    Size padTo = size.width <= options.maxSize.width && size.height <= options.maxSize.height ? options.maxSize : size;
+    Size padded(getOptimalDFTSize(padTo.width + 2 * border), getOptimalDFTSize(padTo.height + 2 * border));
+    intensity.create(size, CV_32FC1);
+    if (padded == paddedSize) return;
+    paddedSize = padded;
+
+    std::vector<float> range, azimuth;
+    window(paddedSize.width, options.rangeResolution, options.windowAlpha, range);
+    window(paddedSize.height, options.azimuthResolution, options.windowAlpha, azimuth);
+
+    // separable and real: H(v, u) = W_azimuth(v) W_range(u)
+    transfer.create(paddedSize, CV_32FC2);
+    double rangeEnergy = 0, azimuthEnergy = 0;
+    for (float w : range) rangeEnergy += w * w;
+    for (float w : azimuth) azimuthEnergy += w * w;
+    for (int y = 0; y < paddedSize.height; y++)
+    {
+        cv::Vec2f* t = transfer.ptr<cv::Vec2f>(y);
+        for (int x = 0; x < paddedSize.width; x++) t[x] = cv::Vec2f(azimuth[y] * range[x], 0);
+    }
+
+    // sum |h|^2 = mean |H|^2 (Parseval)
+    gain = (float)(rangeEnergy / paddedSize.width * azimuthEnergy / paddedSize.height);
+
+    amplitude.create(paddedSize, CV_32FC1);
+    field.create(paddedSize, CV_32FC2);
+    spectrum.create(paddedSize, CV_32FC2);
+}
+
+void SARImaging::apply(cv::Mat& reflectivity, unsigned seed)
+{
+    CV_Assert(reflectivity.type() == CV_32FC1);
+    prepare(reflectivity.size());
+
+    int right = paddedSize.width - imageSize.width - border;
+    int bottom = paddedSize.height - imageSize.height - border;
+    copyMakeBorder(reflectivity, amplitude, border, bottom, border, right, BORDER_REFLECT);
+    for (int y = 0; y < amplitude.rows; y++)
+    {
+        float* a = amplitude.ptr<float>(y);
+        for (int x = 0; x < amplitude.cols; x++) a[x] = std::sqrt(std::max(a[x], 0.0f));
+    }
+
+    intensity.setTo(cv::Scalar(0));
+    cv::RNG rng(seed);
+    float scale = 1.0f / (gain * options.looks);
+
+    for (int look = 0; look < options.looks; look++)
+    {
+        // circular gaussian scatterers of unit power, weighted by the amplitude
+        rng.fill(field, cv::RNG::NORMAL, cv::Scalar(0, 0), cv::Scalar(std::sqrt(0.5), std::sqrt(0.5)));
+        for (int y = 0; y < field.rows; y++)
+        {
+            const float* a = amplitude.ptr<float>(y);
+            cv::Vec2f* f = field.ptr<cv::Vec2f>(y);
+            for (int x = 0; x < field.cols; x++)
+            {
+                f[x][0] *= a[x];
+                f[x][1] *= a[x];
+            }
+        }
+
+        // one 2D transform does the row passes as a batch, then the column passes
+        dft(field, spectrum, DFT_COMPLEX_OUTPUT);
+        mulSpectrums(spectrum, transfer, spectrum, 0);
+        idft(spectrum, field, DFT_SCALE | DFT_COMPLEX_OUTPUT);
+
+        for (int y = 0; y < imageSize.height; y++)
+        {
+            const cv::Vec2f* f = field.ptr<cv::Vec2f>(y + border) + border;
+            float* i = intensity.ptr<float>(y);
+            for (int x = 0; x < imageSize.width; x++) i[x] += (f[x][0] * f[x][0] + f[x][1] * f[x][1]) * scale;
+        }
+    }
+
+    intensity.copyTo(reflectivity);
+}
@@ -0,0 +1,59 @@
+#ifndef HEIGHTMAP_SARIMAGING_H
+#define HEIGHTMAP_SARIMAGING_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+struct ImagingOptions
+{
+    // -3 dB width of the impulse response in output pixels, along range (columns) and azimuth (rows)
+    float rangeResolution = 2;
+    float azimuthResolution = 2;
+    // spectral weighting: 1 is a plain sinc, 0.54 a Hamming window with lower side lobes and a wider main lobe
+    float windowAlpha = 1;
+    // independent looks averaged into the intensity, fewer looks give stronger speckle
+    int looks = 1;
+    // largest image expected: every image up to it is padded to the DFT size of maxSize, so native range pairs,
+    // whose width changes with every sample, share one PSF spectrum and one set of buffers. Empty pads every image
+    // to its own size
+    Size maxSize;
+};
+
+// Coherent imaging of a projected reflectivity map: every pixel scatters a circular gaussian complex field with the
+// pixel's reflectivity as power, the field is convolved with a separable sinc-like point spread function in the
+// frequency domain and the intensity is taken. Speckle is then spatially correlated over the impulse response, as in
+// real SAR images, and its mean follows the reflectivity.
+//
+// The image is padded (reflected) by the PSF support to an optimal DFT size, of options.maxSize when it fits. The PSF
+// spectrum and all buffers are kept for the next image of the same padded size, so one SARImaging per thread serves a
+// whole data set.
+class SARImaging
+{
+public:
+    explicit SARImaging(const ImagingOptions& = ImagingOptions());
+
+    // replaces the reflectivity (CV_32FC1, negative values taken as 0) by the simulated intensity
+    void apply(cv::Mat& reflectivity, unsigned seed);
+
+private:
+    ImagingOptions options;
+
+    Size imageSize;
+    Size paddedSize;
+    int border;
+    cv::Mat transfer;       // CV_32FC2 PSF spectrum
+    float gain;             // energy of the PSF, so the intensity keeps the reflectivity scale
+
+    cv::Mat amplitude;
+    cv::Mat field;
+    cv::Mat spectrum;
+    cv::Mat intensity;
+
+    void prepare(Size);
+    static void window(int n, float resolution, float alpha, std::vector<float>& w);
+};
+
+#endif //HEIGHTMAP_SARIMAGING_H
@@ -0,0 +1,118 @@
+#include "taskGraph.h"
+#include <algorithm>
+#include <stdexcept>
+
+const TaskGraph::Task TaskGraph::none;
+
+TaskGraph::Task TaskGraph::add(std::function<void()> run, const std::vector<Task>& dependencies)
+{
+    Task task = nodes.size();
+    int count = 0;
+    for (Task d : dependencies)
+    {
+        if (d == none) continue;
+        if (d >= task) throw std::invalid_argument("TaskGraph: dependency on a task not added yet");
+        nodes[d].successors.push_back(task);
+        count++;
+    }
+
+    nodes.push_back({std::move(run), {}, count});
+    return task;
+}
+
+size_t TaskGraph::size() const
+{
+    return nodes.size();
+}
+//-------------------------------------------------------------------------
+
+TaskScheduler::TaskScheduler(unsigned threads) : graph(nullptr), remaining(0), stop(false)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // the thread calling run() is one of them
+    for (unsigned i = 1; i < threads; i++) workers.emplace_back(&TaskScheduler::work, this);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+unsigned TaskScheduler::getThreads() const
+{
+    return (unsigned)workers.size() + 1;
+}
+
+void TaskScheduler::execute(std::unique_lock<std::mutex>& lock)
+{
+    TaskGraph::Task task = ready.front();
+    ready.pop_front();
+    TaskGraph::Node& node = graph->nodes[task];
+    bool skip = (bool)error;
+
+    lock.unlock();
+    std::exception_ptr thrown;
+    if (!skip)
+    {
+        try
+        {
+            node.run();
+        }
+        catch (...)
+        {
+            thrown = std::current_exception();
+        }
+    }
+    lock.lock();
+
+    if (thrown && !error) error = thrown;
+    for (TaskGraph::Task s : node.successors)
+    {
+        if (--waiting[s] == 0) ready.push_back(s);
+    }
+    remaining--;
+    changed.notify_all();
+}
+
+void TaskScheduler::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        changed.wait(lock, [this] { return stop || !ready.empty(); });
+        if (stop) return;
+        execute(lock);
+    }
+}
+
+void TaskScheduler::run(TaskGraph& tasks)
+{
+    std::lock_guard<std::mutex> serial(runMutex);
+    std::unique_lock<std::mutex> lock(mutex);
+
+    graph = &tasks;
+    remaining = tasks.nodes.size();
+    error = nullptr;
+    waiting.resize(remaining);
+    for (size_t t = 0; t < remaining; t++)
+    {
+        waiting[t] = tasks.nodes[t].dependencies;
+        if (waiting[t] == 0) ready.push_back(t);
+    }
+    changed.notify_all();
+
+    while (remaining > 0)
+    {
+        if (!ready.empty()) execute(lock);
+        else changed.wait(lock);
+    }
+    graph = nullptr;
+
+    if (error) std::rethrow_exception(error);
+}
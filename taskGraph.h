@@ -0,0 +1,75 @@
+#ifndef HEIGHTMAP_TASKGRAPH_H
+#define HEIGHTMAP_TASKGRAPH_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Tasks and the tasks they wait for. A task becomes ready as soon as everything it depends on has finished, so a
+// stage split into tiles overlaps with the next one: a tile starts when its own input tiles are done, not when the
+// whole previous stage is.
+class TaskGraph
+{
+public:
+    typedef size_t Task;
+    // no task, ignored in dependency lists
+    static const Task none = (Task)-1;
+
+    // dependencies must be tasks added before
+    Task add(std::function<void()>, const std::vector<Task>& dependencies = {});
+    size_t size() const;
+
+private:
+    friend class TaskScheduler;
+
+    struct Node
+    {
+        std::function<void()> run;
+        std::vector<Task> successors;
+        int dependencies;
+    };
+
+    std::vector<Node> nodes;
+};
+
+// Worker threads shared by every graph run on it. One graph runs at a time and the calling thread works on it too.
+class TaskScheduler
+{
+public:
+    // 0: one thread per hardware thread
+    explicit TaskScheduler(unsigned threads = 0);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // blocks until every task has run. The first exception thrown by a task is rethrown here, the tasks that had not
+    // started by then are skipped
+    void run(TaskGraph&);
+    unsigned getThreads() const;
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex runMutex;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<TaskGraph::Task> ready;
+    std::vector<int> waiting;
+    TaskGraph* graph;
+    size_t remaining;
+    std::exception_ptr error;
+    bool stop;
+
+    // runs one ready task, mutex held on entry and exit
+    void execute(std::unique_lock<std::mutex>&);
+    void work();
+};
+
+#endif //HEIGHTMAP_TASKGRAPH_H
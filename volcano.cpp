@@ -100,6 +100,12 @@ namespace syntheticVolcano
         return (pointRatioConcave(Point(x,y)));
     }
 
+    float Ellipse::pointRatioConcave(const Point2f& p)
+    {
+        if(!axes[0] || !axes[1]) return 0;
+        return 1-(pow(p.x-center.x,2)/pow(axes[0],2) + pow((p.y-center.y),2)/pow(axes[1],2));
+    }
+
     float Ellipse::pointRatioConvex(const Point& p, float power)
     {
         float val = pointRatioConcave(p);
@@ -150,6 +156,15 @@ namespace syntheticVolcano
         return pointRatioCircleBased(Point(x, y), mode);
     }
 
+    float Ellipse::pointRatioCircleBased(const Point2f& p, AXES mode)
+    {
+        float pDist = hypot(p.x - center.x, p.y - center.y);
+        float radius = mode ? axes[1] : axes[0];
+
+        float val = radius == 0 ? 0 : 1- pDist/radius;
+        return val;
+    }
+
     std::ostream& operator<<(std::ostream& os, Ellipse ell)
     {
         return os << "Ellipse center x: "     << ell.getCenter().x  <<
@@ -160,8 +175,9 @@ namespace syntheticVolcano
     }
     //-------------------------------------------------------------------------
 
-    Volcano::Volcano(VolcanoData _vd, unsigned _SARAvHeight, float _angle2sat) :
-                     SARAvHeight(_SARAvHeight), angle2sat(_angle2sat)
+    Volcano::Volcano(VolcanoData _vd, unsigned _SARAvHeight, float _angle2sat, const VolcanoOptions& _options) :
+                     options(_options), SARAvHeight(_SARAvHeight), angle2sat(_angle2sat),
+                     speckleSeed(std::default_random_engine::default_seed)
     {
         vd = _vd;
 
@@ -171,97 +187,604 @@ namespace syntheticVolcano
         coorTranVector.x = base.getCenter().x - SARAvHeight/2;
         coorTranVector.y = base.getCenter().y - SARAvHeight/2;
 
-        v2sat = Vec3f(-sin(angle2sat), 0, cos(angle2sat));
+        v2sat = lookVector(angle2sat, ASCENDING);
+
+        // drawn in the order makeDEM and makeNormals used to draw them
+        if (!vd.demSeed) vd.demSeed = std::rand();
+        if (!vd.albedoSeed) vd.albedoSeed = std::rand();
+
+        uint64_t cacheKey = 0;
+        if (options.cache)
+        {
+            cacheKey = DEMCache::key(vd, SARAvHeight, options.noise, options.coarseFactor);
+            if (options.cache->load(cacheKey, DEM, Albedo))
+            {
+                cout << "Volcano Object: DEM loaded from cache" << endl;
+            }
+        }
+
+        if (options.scheduler && !options.incremental)
+        {
+            renderTiled(DEM.empty(), cacheKey);
+            return;
+        }
 
-        makeDEM();
-        makeReflection();
-        project();
+        if (DEM.empty())
+        {
+            makeDEM();
+            makeAlbedo();
+            if (options.cache) options.cache->store(cacheKey, DEM, Albedo);
+        }
+        makeNormals();
+        makeReflection(v2sat, Reflection);
+        if (options.incremental && options.projection == NATIVE_RANGE) projectPrimary();
+        else project(v2sat, Reflection, DEM2SAR, Reflection2SAR, Layover2SAR, Shadow2SAR, speckleSeed);
     }
 
-    void Volcano::project()
+    // The constructor pipeline as a graph of row band tasks. Global quantities (the crater heights, the DEM and
+    // reflection shifts, the projection width) are single reduction tasks; everything else depends only on the bands
+    // it reads: normals on the neighbouring DEM bands, hole filling on the band below and on the band above being
+    // filled, speckle on both fills that read the band.
+    void Volcano::renderTiled(bool makeTerrain, uint64_t cacheKey)
     {
-        cout << "Volcano Object: projecting" << endl;
+        cout << "Volcano Object: rendering in bands on " << options.scheduler->getThreads() << " threads" << endl;
+
+        typedef TaskGraph::Task Task;
+        const Task none = TaskGraph::none;
+
+        // hole filling reads two rows into the next band
+        int bandRows = std::max(options.tileRows, 2);
+        int rows = SARAvHeight;
+        int bands = (rows + bandRows - 1) / bandRows;
+        auto y0 = [=](int b) { return b * bandRows; };
+        auto y1 = [=](int b) { return std::min(rows, (b + 1) * bandRows); };
+        auto band = [&](const cv::Mat& m, int b) { return m.rowRange(y0(b), y1(b)); };
+
+        TaskGraph graph;
+        std::vector<Task> demReady(bands, none), albedoReady(bands, none);
+
+        // terrain: noise, base slopes, crater heights, crater and plain, shift
+        std::unique_ptr<NoiseEngine> demEngine, albedoEngine;
+        std::vector<float> bandMaxBaseS(bands, 0), bandRimMin(bands, MAXFLOAT), bandMin(bands, 0);
+        if (makeTerrain)
+        {
+            DEM = Mat(rows, rows, CV_32FC1, 0.0);
+            Albedo.create(rows, rows, CV_32FC1);
+            demEngine = makeNoiseEngine(options.noise, vd.demSeed);
+            albedoEngine = makeNoiseEngine(options.noise, vd.albedoSeed);
+
+            bool coarse = options.coarseFactor > 1;
+            if (!coarse) DEMNoise.create(rows, rows, CV_32FC1);
+            Task coarseFields = coarse ? graph.add([&] { makeCoarseDEMFields(*demEngine); }) : none;
+
+            std::vector<Task> base(bands);
+            for (int b = 0; b < bands; b++)
+            {
+                albedoReady[b] = graph.add([&, b]
+                {
+                    albedoEngine->fieldRows(rows, rows, y0(b), y1(b), Albedo);
+                    Mat a = band(Albedo, b);
+                    a = abs(a);
+                });
+
+                Task noise = coarse ? coarseFields :
+                             graph.add([&, b] { demEngine->fieldRows(rows, rows, y0(b), y1(b), DEMNoise); });
+                base[b] = graph.add([&, b] { demBaseRows(y0(b), y1(b), bandMaxBaseS[b], bandRimMin[b]); }, {noise});
+            }
+
+            Task reduceHeights = graph.add([&]
+            {
+                float maxBaseS = *std::max_element(bandMaxBaseS.begin(), bandMaxBaseS.end());
+                float rimMin = *std::min_element(bandRimMin.begin(), bandRimMin.end());
+                terrainHeights = craterHeights(maxBaseS, rimMin);
+            }, base);
+
+            std::vector<Task> crater(bands);
+            for (int b = 0; b < bands; b++)
+            {
+                crater[b] = graph.add([&, b]
+                {
+                    demCraterRows(y0(b), y1(b), terrainHeights);
+                    double min, max;
+                    minMaxLoc(band(DEM, b), &min, &max);
+                    bandMin[b] = (float)min;
+                }, {reduceHeights});
+            }
+
+            Task reduceShift = graph.add([&]
+            {
+                float min = *std::min_element(bandMin.begin(), bandMin.end());
+                terrainShift = min < 0 ? abs(min) : 0;
+                terrainKnown = true;
+            }, crater);
+
+            for (int b = 0; b < bands; b++)
+            {
+                demReady[b] = graph.add([&, b]
+                {
+                    if (terrainShift > 0)
+                    {
+                        Mat d = band(DEM, b);
+                        d += terrainShift;
+                    }
+                }, {reduceShift});
+            }
 
-        Mat Range = Mat(DEM.rows, DEM.cols, CV_32FC1, 0.0);
+            std::vector<Task> terrain(demReady);
+            terrain.insert(terrain.end(), albedoReady.begin(), albedoReady.end());
+            graph.add([&]
+            {
+                BaseRatio.release();
+                OutsideRatio.release();
+                if (options.cache) options.cache->store(cacheKey, DEM, Albedo);
+            }, terrain);
+        }
 
-        for (int y = 0; y < DEM.rows; y++)
+        // normals with a one row halo, then reflection
+        Normals.create(rows, rows, CV_32FC3);
+        Reflection.create(rows, rows, CV_32FC1);
+        std::vector<Task> reflected(bands);
+        for (int b = 0; b < bands; b++)
         {
-            for (int x = 0; x < DEM.cols; x++)
+            Task normals = graph.add([&, b]
+            {
+                int top = std::max(y0(b) - 1, 0);
+                int bottom = std::min(y1(b) + 1, rows);
+                Mat n, out = band(Normals, b);
+                kernels::normals(DEM.rowRange(top, bottom), n);
+                n.rowRange(y0(b) - top, y1(b) - top).copyTo(out);
+            }, {b > 0 ? demReady[b - 1] : none, demReady[b], b + 1 < bands ? demReady[b + 1] : none});
+
+            reflected[b] = graph.add([&, b] { reflectRows(v2sat, Reflection, y0(b), y1(b)); },
+                                     {normals, albedoReady[b]});
+        }
+
+        Task reflectionShift = graph.add([&]
+        {
+            double min, max;
+            minMaxLoc(Reflection, &min, &max);
+            if(min < 0) Reflection += abs(min);
+        }, reflected);
+
+        projectTiled(graph, demReady, reflectionShift);
+    }
+
+    // Adds the primary projection, hole filling and speckle of the DEM and reflection to graph, after the given DEM
+    // bands (empty: all ready) and reflection, and runs it. The band layout and the speckle seeds are those of
+    // renderTiled(), so update() reproduces its output
+    void Volcano::projectTiled(TaskGraph& graph, const std::vector<TaskGraph::Task>& demReady,
+                               TaskGraph::Task reflectionReady)
+    {
+        typedef TaskGraph::Task Task;
+        const Task none = TaskGraph::none;
+
+        int bandRows = std::max(options.tileRows, 2);
+        int rows = SARAvHeight;
+        int bands = (rows + bandRows - 1) / bandRows;
+        auto y0 = [=](int b) { return b * bandRows; };
+        auto y1 = [=](int b) { return std::min(rows, (b + 1) * bandRows); };
+        auto band = [&](const cv::Mat& m, int b) { return m.rowRange(y0(b), y1(b)); };
+        auto demBand = [&](int b) { return demReady.empty() ? none : demReady[b]; };
+
+        if (options.projection == FIXED_SHAPE)
+        {
+            // the splat and the row resampling need the whole image
+            std::vector<Task> inputs(demReady);
+            inputs.push_back(reflectionReady);
+            graph.add([&] { project(v2sat, Reflection, DEM2SAR, Reflection2SAR, Layover2SAR, Shadow2SAR,
+                                    speckleSeed); }, inputs);
+            options.scheduler->run(graph);
+            return;
+        }
+
+        // slant range, projection width, scatter
+        kernels::RangeGeometry geometry;
+        kernels::prepareRange(DEM, options.masks, geometry);
+        cv::Mat* layover = options.masks ? &Layover2SAR : nullptr;
+        cv::Mat* shadow = options.masks ? &Shadow2SAR : nullptr;
+        float shift = 0;
+
+        std::vector<Task> ranged(bands);
+        for (int b = 0; b < bands; b++)
+        {
+            ranged[b] = graph.add([&, b] { kernels::slantRangeRows(DEM, v2sat, y0(b), y1(b), geometry); },
+                                  {demBand(b)});
+        }
+
+        Task width = graph.add([&]
+        {
+            double max;
+            shift = kernels::rangeShift(geometry, max);
+            kernels::prepareProjection(rows, (int)((float)max + shift) + 1, DEM2SAR, Reflection2SAR, layover, shadow);
+        }, ranged);
+
+        std::vector<Task> scattered(bands);
+        for (int b = 0; b < bands; b++)
+        {
+            scattered[b] = graph.add([&, b]
+            {
+                kernels::projectRows(DEM, Reflection, geometry, shift, y0(b), y1(b), DEM2SAR, Reflection2SAR,
+                                     layover, shadow);
+            }, {width, reflectionReady});
+        }
+
+        // holes in raster order: each band waits for the band above to be filled and the band below to be projected
+        std::vector<Task> demFilled(bands), refFilled(bands);
+        for (int b = 0; b < bands; b++)
+        {
+            Task below = b + 1 < bands ? scattered[b + 1] : none;
+            demFilled[b] = graph.add([&, b] { kernels::fillHolesRows(DEM2SAR, 5, y0(b), y1(b)); },
+                                     {scattered[b], below, b > 0 ? demFilled[b - 1] : none});
+            refFilled[b] = graph.add([&, b] { kernels::fillHolesRows(Reflection2SAR, 5, y0(b), y1(b)); },
+                                     {scattered[b], below, b > 0 ? refFilled[b - 1] : none});
+        }
+
+        // the impulse response couples every row, so imaging waits for the whole reflection
+        if (options.imaging)
+        {
+            graph.add([&] { options.imaging->apply(Reflection2SAR, speckleSeed); }, refFilled);
+        }
+        else
+        {
+            // the fill of the next band reads the last rows of this one, so both must be done
+            for (int b = 0; b < bands; b++)
             {
-                Vec3f demP =  Vec3f(x, y, DEM.at<float>(y, x));
-                Range.at<float>(y, x) = demP.dot(v2sat);
+                graph.add([&, b]
+                {
+                    Mat r = band(Reflection2SAR, b);
+                    kernels::speckle(r, speckleSeed + 0x9E3779B9u * (unsigned)b);
+                }, {refFilled[b], b + 1 < bands ? refFilled[b + 1] : none});
             }
         }
 
-        double min, max;
-        minMaxLoc(Range, &min, &max);
-        if(min < 0)
+        options.scheduler->run(graph);
+    }
+
+    cv::Vec3f Volcano::lookVector(float angle, LookDirection look)
+    {
+        float x = look == ASCENDING ? -sin(angle) : sin(angle);
+        return Vec3f(x, 0, cos(angle));
+    }
+
+    // slant range = x * v[0] + height * v[2] over heights in [0, maxHeight] (the DEM is shifted to be non negative)
+    float Volcano::rangeExtent(unsigned size, float angle, float maxHeight)
+    {
+        return (size - 1) * std::fabs(sin(angle)) + maxHeight * std::fabs(cos(angle));
+    }
+
+    std::vector<SARPair> Volcano::fanOut(const std::vector<SARGeometry>& geometries)
+    {
+        std::vector<SARPair> pairs;
+        Mat reflection;
+
+        for (const SARGeometry& g : geometries)
+        {
+            SARPair pair;
+            pair.geometry = g;
+
+            Vec3f v = lookVector(g.angle2sat, g.look);
+            makeReflection(v, reflection);
+            project(v, reflection, pair.DEM2SAR, pair.Reflection2SAR, pair.Layover2SAR, pair.Shadow2SAR,
+                    g.speckleSeed);
+
+            pairs.push_back(pair);
+        }
+
+        return pairs;
+    }
+
+    void Volcano::project(const cv::Vec3f& v, const cv::Mat& reflection, cv::Mat& dem2sar, cv::Mat& reflection2sar,
+                          cv::Mat& layover2sar, cv::Mat& shadow2sar, unsigned speckleSeed)
+    {
+        cout << "Volcano Object: projecting" << endl;
+
+        cv::Mat* layover = options.masks ? &layover2sar : nullptr;
+        cv::Mat* shadow = options.masks ? &shadow2sar : nullptr;
+
+        if (options.projection == FIXED_SHAPE)
+        {
+            kernels::projectSplat(DEM, reflection, v, options.outputWidth, options.rangeScale, dem2sar, reflection2sar,
+                                  layover, shadow);
+        }
+        else
         {
-            Range += abs(min);
-            minMaxLoc(Range, &min, &max);
+            kernels::project(DEM, reflection, v, dem2sar, reflection2sar, layover, shadow);
         }
 
-        DEM2SAR = Mat(DEM.rows, (int)max, CV_32FC1, cv::Scalar(-1));
-        Reflection2SAR = Mat(DEM.rows, (int)max, CV_32FC1, cv::Scalar(-1));
+        kernels::fillHoles(dem2sar);
+        kernels::fillHoles(reflection2sar);
 
-        int xVal;
-        for (int y = 0; y < DEM.rows; y++)
+        // speckle is added on the final grid, so its statistics do not depend on the resampling
+        if (options.projection == FIXED_SHAPE && dem2sar.rows != options.outputHeight)
         {
-            for (int x = 0; x < DEM.cols; x++)
+            Size shape(options.outputWidth, options.outputHeight);
+            resize(dem2sar, dem2sar, shape, 0, 0, INTER_LINEAR);
+            resize(reflection2sar, reflection2sar, shape, 0, 0, INTER_LINEAR);
+            if (layover) resize(layover2sar, layover2sar, shape, 0, 0, INTER_NEAREST);
+            if (shadow) resize(shadow2sar, shadow2sar, shape, 0, 0, INTER_NEAREST);
+        }
+
+        if (options.imaging) options.imaging->apply(reflection2sar, speckleSeed);
+        else kernels::speckle(reflection2sar, speckleSeed);
+    }
+
+    // The primary native range projection through the row kernels (same output as project()), keeping the slant
+    // ranges, the rows before hole filling and the speckle draws that reprojectRows() starts from
+    void Volcano::projectPrimary()
+    {
+        cout << "Volcano Object: projecting" << endl;
+
+        cv::Mat* layover = options.masks ? &Layover2SAR : nullptr;
+        cv::Mat* shadow = options.masks ? &Shadow2SAR : nullptr;
+
+        double max;
+        kernels::prepareRange(DEM, options.masks, rangeGeometry);
+        kernels::slantRangeRows(DEM, v2sat, 0, DEM.rows, rangeGeometry);
+        rangeShift = kernels::rangeShift(rangeGeometry, max);
+        kernels::prepareProjection(DEM.rows, (int)((float)max + rangeShift) + 1, ProjectedDEM, ProjectedReflection,
+                                   layover, shadow);
+        kernels::projectRows(DEM, Reflection, rangeGeometry, rangeShift, 0, DEM.rows, ProjectedDEM,
+                             ProjectedReflection, layover, shadow);
+
+        ProjectedDEM.copyTo(DEM2SAR);
+        ProjectedReflection.copyTo(FilledReflection);
+        kernels::fillHoles(DEM2SAR);
+        kernels::fillHoles(FilledReflection);
+
+        // the draws of kernels::speckle(), kept in double as they are added
+        Speckle.create(FilledReflection.rows, FilledReflection.cols, CV_64FC1);
+        std::default_random_engine generator(speckleSeed);
+        std::gamma_distribution<double> distribution(2.0,2.0);
+        for (int y = 0; y < Speckle.rows; y++)
+        {
+            double* row = Speckle.ptr<double>(y);
+            for (int x = 0; x < Speckle.cols; x++) row[x] = distribution(generator);
+        }
+
+        Reflection2SAR.create(FilledReflection.rows, FilledReflection.cols, CV_32FC1);
+        addSpeckle(0, Reflection2SAR.rows);
+    }
+
+    // rows [y0, y1) of Reflection2SAR from the filled reflection, through the imaging stage (whole image) if set
+    void Volcano::addSpeckle(int y0, int y1)
+    {
+        if (options.imaging)
+        {
+            FilledReflection.copyTo(Reflection2SAR);
+            options.imaging->apply(Reflection2SAR, speckleSeed);
+            return;
+        }
+
+        for (int y = y0; y < y1; y++)
+        {
+            const float* filled = FilledReflection.ptr<float>(y);
+            const double* speckle = Speckle.ptr<double>(y);
+            float* row = Reflection2SAR.ptr<float>(y);
+            for (int x = 0; x < Reflection2SAR.cols; x++)
             {
-                xVal = Range.at<float>(y, x);
-                DEM2SAR.at<float>(y, xVal) = DEM.at<float>(y, x);
-                Reflection2SAR.at<float>(y, xVal) = Reflection.at<float>(y, x);
+                float value = filled[x];
+                value += speckle[x];
+                row[x] = value;
             }
         }
+    }
 
-        extrapolate_mat(DEM2SAR);
-        extrapolate_mat(Reflection2SAR);
+    // Hole filling runs in raster order, a row reads the two filled rows above it and the two projected rows below.
+    // After rows [y0, y1) were projected again it restarts two rows above them and stops once two consecutive rows
+    // at or past y1 - 1 come out as before: every row below then reads the same input. Returns the end of the
+    // refilled rows
+    int Volcano::refillRows(const cv::Mat& projected, cv::Mat& filled, int y0, int y1)
+    {
+        int rows = projected.rows;
+        int start = std::max(y0 - 2, 0);
+        size_t rowBytes = filled.cols * filled.elemSize();
 
-        speckle(Reflection2SAR);
+        // rows at or below the one being filled must hold projected values, the filled ones are kept to compare
+        std::vector<cv::Mat> before;
+        auto load = [&](int y)
+        {
+            if (y >= rows || y - start < (int)before.size()) return;
+            Mat row = filled.row(y);
+            before.push_back(row.clone());
+            projected.row(y).copyTo(row);
+        };
+
+        int y = start;
+        int unchanged = 0;
+        while (y < rows)
+        {
+            load(y);
+            load(y + 1);
+            load(y + 2);
+            kernels::fillHolesRows(filled, 5, y, y + 1);
+
+            unchanged = memcmp(filled.ptr(y), before[y - start].ptr(), rowBytes) ? 0 : unchanged + 1;
+            y++;
+            if (unchanged >= 2 && y >= y1) break;
+        }
+
+        // the projected rows loaded past the stop fill exactly as before
+        for (int r = y; r < start + (int)before.size(); r++)
+        {
+            Mat row = filled.row(r);
+            before[r - start].copyTo(row);
+        }
+
+        return y;
     }
 
-    void Volcano::makeReflection()
+    // projection of DEM rows [y0, y1) whose heights or reflection changed. A change of the range extent moves every
+    // column, the whole pair is projected again then
+    void Volcano::reprojectRows(int y0, int y1)
     {
-        cout << "Volcano Object: reflecting DEM" << endl;
+        double max;
+        kernels::slantRangeRows(DEM, v2sat, y0, y1, rangeGeometry);
+        float shift = kernels::rangeShift(rangeGeometry, max);
+        if (shift != rangeShift || (int)((float)max + shift) + 1 != ProjectedDEM.cols)
+        {
+            projectPrimary();
+            return;
+        }
+
+        cout << "Volcano Object: re-projecting rows " << y0 << " to " << y1 << endl;
 
-        Reflection = Mat(DEM.rows, DEM.cols, CV_32FC1, 0.0);
-        Normals = Mat(DEM.rows, DEM.cols, CV_32FC3, 0.0);
+        cv::Mat* layover = options.masks ? &Layover2SAR : nullptr;
+        cv::Mat* shadow = options.masks ? &Shadow2SAR : nullptr;
+        ProjectedDEM.rowRange(y0, y1).setTo(cv::Scalar(-1));
+        ProjectedReflection.rowRange(y0, y1).setTo(cv::Scalar(-1));
+        for (cv::Mat* mask : {layover, shadow})
+        {
+            if (mask) mask->rowRange(y0, y1).setTo(cv::Scalar(0));
+        }
+        kernels::projectRows(DEM, Reflection, rangeGeometry, rangeShift, y0, y1, ProjectedDEM, ProjectedReflection,
+                             layover, shadow);
 
-        unsigned int seed = std::rand();
-        PerlinNoise pn(seed);
+        refillRows(ProjectedDEM, DEM2SAR, y0, y1);
+        int end = refillRows(ProjectedReflection, FilledReflection, y0, y1);
+        addSpeckle(std::max(y0 - 2, 0), end);
+    }
 
-        for (int y = 0; y < DEM.rows; y++)
+    bool Volcano::update(const VolcanoData& _vd)
+    {
+        bool sameEdifice = _vd.height == vd.height &&
+                           _vd.baseLongAxisPixels == vd.baseLongAxisPixels &&
+                           _vd.baseShortAxisPixels == vd.baseShortAxisPixels &&
+                           _vd.craterLongAxisPixels == vd.craterLongAxisPixels &&
+                           _vd.craterShortAxisPixels == vd.craterShortAxisPixels &&
+                           _vd.baseCenter == vd.baseCenter &&
+                           _vd.craterCenter == vd.craterCenter &&
+                           _vd.demSeed == vd.demSeed &&
+                           _vd.albedoSeed == vd.albedoSeed;
+        bool craterChanged = _vd.craterMinHeightRatio != vd.craterMinHeightRatio ||
+                             _vd.craterFallRatio != vd.craterFallRatio;
+
+        if (!sameEdifice || (craterChanged && !terrainKnown))
         {
-            for (int x = 0; x < DEM.cols; x++)
+            *this = Volcano(_vd, SARAvHeight, angle2sat, options);
+            return false;
+        }
+
+        // craterMaxHeight, craterMinHeight and craterFall are not read by the renderer
+        vd = _vd;
+        if (!craterChanged) return true;
+
+        cout << "Volcano Object: updating crater" << endl;
+
+        // crater bounding box in image coordinates
+        Point c = crater.getCenter() - coorTranVector;
+        Rect dirty(c.x - (int)crater.getLongAxis(), c.y - (int)crater.getShortAxis(),
+                   2 * crater.getLongAxis() + 1, 2 * crater.getShortAxis() + 1);
+        Rect image(0, 0, DEM.cols, DEM.rows);
+        dirty &= image;
+        if (dirty.area() == 0) return true;
+
+        // the new crater must not go below the DEM minimum, and the old one must not hold it, or the shift changes
+        DEMHeights heights = craterHeights(terrainHeights.maxH, terrainHeights.maxH);
+        float lowest = terrainShift > 0 ? -terrainShift : 0;
+        Mat craterH(dirty.size(), CV_32FC1);
+        for (int y = 0; y < dirty.height; y++)
+        {
+            for (int x = 0; x < dirty.width; x++)
             {
-                Point p(x, y);
+                Point p(dirty.x + x, dirty.y + y);
+                if (!crater.isPointInside(imCoor2EllCoor(p))) continue;
+
+                float h = craterPoint(p, heights);
+                if (h < lowest || (terrainShift > 0 && DEM.at<float>(p.y, p.x) == 0))
+                {
+                    *this = Volcano(vd, SARAvHeight, angle2sat, options);
+                    return false;
+                }
+                craterH.at<float>(y, x) = h;
+            }
+        }
+
+        terrainHeights = heights;
+        for (int y = 0; y < dirty.height; y++)
+        {
+            for (int x = 0; x < dirty.width; x++)
+            {
+                Point p(dirty.x + x, dirty.y + y);
+                if (!crater.isPointInside(imCoor2EllCoor(p))) continue;
+
+                float h = craterH.at<float>(y, x);
+                if (terrainShift > 0) h += terrainShift;
+                DEM.at<float>(p.y, p.x) = h;
+            }
+        }
+
+        // normals one pixel around the crater, computed with one more pixel of halo; reflection of their rows. The
+        // reflection is never negative, so its shift stays 0
+        Rect changed = Rect(dirty.x - 1, dirty.y - 1, dirty.width + 2, dirty.height + 2) & image;
+        Rect halo = Rect(changed.x - 1, changed.y - 1, changed.width + 2, changed.height + 2) & image;
+        Mat n, out = Normals(changed);
+        kernels::normals(DEM(halo), n);
+        n(Rect(changed.x - halo.x, changed.y - halo.y, changed.width, changed.height)).copyTo(out);
+        reflectRows(v2sat, Reflection, changed.y, changed.y + changed.height);
+
+        if (ProjectedDEM.empty() && options.scheduler)
+        {
+            // the bands and per band speckle seeds of a fresh tiled render
+            TaskGraph graph;
+            projectTiled(graph, {}, TaskGraph::none);
+        }
+        else if (ProjectedDEM.empty())
+        {
+            project(v2sat, Reflection, DEM2SAR, Reflection2SAR, Layover2SAR, Shadow2SAR, speckleSeed);
+        }
+        else
+        {
+            reprojectRows(changed.y, changed.y + changed.height);
+        }
+
+        return true;
+    }
+
+    // normals and albedo do not depend on the viewing geometry, they are computed once per DEM
+    void Volcano::makeNormals()
+    {
+        cout << "Volcano Object: computing normals" << endl;
+
+        kernels::normals(DEM, Normals);
+    }
+
+    void Volcano::makeAlbedo()
+    {
+        makeNoiseEngine(options.noise, vd.albedoSeed)->field(DEM.rows, DEM.cols, Albedo);
+        Albedo = abs(Albedo);
+    }
+
+    void Volcano::makeReflection(const cv::Vec3f& v, cv::Mat& reflection)
+    {
+        cout << "Volcano Object: reflecting DEM" << endl;
 
-                float dzdx = (DEM.at<float>(y, x + 1) - DEM.at<float>(y, x - 1)) / 2.0;
-                float dzdy = (DEM.at<float>(y + 1, x) - DEM.at<float>(y - 1, x)) / 2.0;
+        reflection = Mat(DEM.rows, DEM.cols, CV_32FC1, 0.0);
+        reflectRows(v, reflection, 0, DEM.rows);
 
-//                Vec3f norm(-dzdx, -dzdy, -1.0f);
-//                normalize(norm, norm, cv::NORM_L1, CV_32FC3);
-                float hyp = sqrt(pow(dzdx, 2) + pow(dzdy, 2) + 1);
-                dzdx /= hyp;
-                dzdy /= hyp;
-                Vec3f norm(-dzdx, -dzdy, -1.0f/hyp);
+        double min, max;
+        minMaxLoc(reflection, &min, &max);
+        if(min < 0) reflection += abs(min);
+    }
 
-                Normals.at<cv::Vec3f>(y, x) = norm;
+    void Volcano::reflectRows(const cv::Vec3f& v, cv::Mat& reflection, int y0, int y1)
+    {
+        if (options.backscatter)
+        {
+            options.backscatter->rows(v, Normals, Albedo, reflection, y0, y1);
+            return;
+        }
 
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = 0; x < DEM.cols; x++)
+            {
                 // reflection = cos(a) times albedo
-                float dot_product = v2sat.dot(norm);
+                float dot_product = v.dot(Normals.at<cv::Vec3f>(y, x));
                 if (dot_product < 0) dot_product = std::numeric_limits<float>::min();
 
-                // albedo
-                float albedo = abs(perlinNoise(p, DEM.rows, DEM.cols, pn));
-                Reflection.at<float>(y, x) = dot_product * albedo;
+                reflection.at<float>(y, x) = dot_product * Albedo.at<float>(y, x);
             }
         }
-
-        double min, max;
-        minMaxLoc(Reflection, &min, &max);
-        if(min < 0) Reflection += abs(min);
     }
 
     void Volcano::makeDEM() {
@@ -270,25 +793,46 @@ namespace syntheticVolcano
         // create image
         DEM = Mat(SARAvHeight, SARAvHeight, CV_32FC1, 0.0);
 
-        unsigned int seed = std::rand();
-        PerlinNoise pn(seed);
-        int surfaceDetails = 10;
+        std::unique_ptr<NoiseEngine> engine = makeNoiseEngine(options.noise, vd.demSeed);
+        if (options.coarseFactor > 1) makeCoarseDEMFields(*engine);
+        else engine->field(DEM.rows, DEM.cols, DEMNoise);
 
         float maxBaseS = 0;
-        std::vector<float> maxBaseV;
-        for (int y = 0; y < DEM.rows; y++)
+        float rimMin = MAXFLOAT;
+        demBaseRows(0, DEM.rows, maxBaseS, rimMin);
+        terrainHeights = craterHeights(maxBaseS, rimMin);
+        demCraterRows(0, DEM.rows, terrainHeights);
+
+        double min, max;
+        minMaxLoc(DEM, &min, &max);
+        terrainShift = min < 0 ? (float)abs(min) : 0;
+        if(min < 0) DEM += abs(min);
+        terrainKnown = true;
+
+        BaseRatio.release();
+        OutsideRatio.release();
+    }
+
+    // base slopes outside the crater. maxBaseS is the highest of them, rimMin the lowest next to the crater
+    void Volcano::demBaseRows(int y0, int y1, float& maxBaseS, float& rimMin)
+    {
+        int surfaceDetails = 10;
+        bool coarse = !BaseRatio.empty();
+
+        for (int y = y0; y < y1; y++)
         {
             for (int x = 0; x < DEM.cols; x++)
             {
                 Point p(x, y);
-                float noise = perlinNoise(p, DEM.rows, DEM.cols, pn);
+                float noise = DEMNoise.at<float>(y, x);
 
                 if(base.isPointInside(imCoor2EllCoor(p)) && !crater.isPointInside(imCoor2EllCoor(p)))
                 {
 //                    float ratio = base.pointRatioLinear(imCoor2EllCoor(p));
 //                    float ratio = base.pointRatioConcave(imCoor2EllCoor(p));
 //                    float ratio = base.pointRatioConvex(imCoor2EllCoor(p), 2.5);
-                    float ratio = base.pointRatioCircleBased(imCoor2EllCoor(p), LONG_AXIS);
+                    float ratio = coarse ? BaseRatio.at<float>(y, x) :
+                                           base.pointRatioCircleBased(imCoor2EllCoor(p), LONG_AXIS);
 //                    float ratio = base.pointRatioCircleBased(imCoor2EllCoor(p), SHORT_AXIS);
 
                     float craterPointH = vd.height * ratio + noise * surfaceDetails;
@@ -304,67 +848,102 @@ namespace syntheticVolcano
                        crater.isPointInside(imCoor2EllCoor(Point(p.x-1, p.y+1))) ||
                        crater.isPointInside(imCoor2EllCoor(Point(p.x-1, p.y-1))))
                     {
-                        maxBaseV.push_back(craterPointH);
+                        if (craterPointH < rimMin) rimMin = craterPointH;
                     }
                 }
             }
         }
+    }
+
+    Volcano::DEMHeights Volcano::craterHeights(float maxBaseS, float rimMin) const
+    {
+        DEMHeights heights;
+        heights.maxH = rimMin < maxBaseS ? rimMin : maxBaseS;
+        heights.craterMinH = heights.maxH * vd.craterMinHeightRatio;
+        heights.craterFall = (heights.maxH - heights.craterMinH) * vd.craterFallRatio;
+        return heights;
+    }
 
-        float minOfVector = MAXFLOAT;
-        if(!maxBaseV.empty()) minOfVector = *std::min_element(std::begin(maxBaseV), std::end(maxBaseV));
-        float maxH = minOfVector < maxBaseS ? minOfVector : maxBaseS;
-        float craterMinH = maxH * vd.craterMinHeightRatio;
-        float craterFall = (maxH - craterMinH) * vd.craterFallRatio;
+    // crater and the plain around the base
+    void Volcano::demCraterRows(int y0, int y1, const DEMHeights& heights)
+    {
+        int surfaceDetails = 10;
+        bool coarse = !OutsideRatio.empty();
 
-        for (int y = 0; y < DEM.rows; y++)
+        for (int y = y0; y < y1; y++)
         {
             for (int x = 0; x < DEM.cols; x++)
             {
                 Point p(x, y);
-                float noise = perlinNoise(p, DEM.rows, DEM.cols, pn);
+                float noise = DEMNoise.at<float>(y, x);
 
                 if(crater.isPointInside(imCoor2EllCoor(p)))
                 {
-//                    float ratioC = crater.pointRatioLinear(imCoor2EllCoor(p));
-//                    float ratioC = crater.pointRatioConcave(imCoor2EllCoor(p));
-                    float ratioC = crater.pointRatioConvex(imCoor2EllCoor(p), 2.5);
-//                    float ratioC = crater.pointRatioCircleBased(imCoor2EllCoor(p), LONG_AXIS);
-//                    float ratioC = crater.pointRatioCircleBased(imCoor2EllCoor(p), SHORT_AXIS);
-
-                    float craterPointH = (1-ratioC) * (maxH - craterFall);
-                    craterPointH = craterPointH > craterMinH ? craterPointH : craterMinH;
-                    DEM.at<float>(y,x) = craterPointH;
+                    DEM.at<float>(y,x) = craterPoint(p, heights);
                 }
                 else if(!(base.isPointInside(imCoor2EllCoor(p))))
                 {
 //                    float ratio = base.pointRatioLinear(imCoor2EllCoor(p));
-                    float ratio = base.pointRatioConcave(imCoor2EllCoor(p));
+                    float ratio = coarse ? OutsideRatio.at<float>(y, x) : base.pointRatioConcave(imCoor2EllCoor(p));
 //                    float ratio = base.pointRatioConvex(imCoor2EllCoor(p), 2.5);
 //                    float ratio = base.pointRatioCircleBased(imCoor2EllCoor(p), LONG_AXIS);
 //                    float ratio = base.pointRatioCircleBased(imCoor2EllCoor(p), SHORT_AXIS);
 
-                    DEM.at<float>(y,x) = maxH * ratio + noise * surfaceDetails;
+                    DEM.at<float>(y,x) = heights.maxH * ratio + noise * surfaceDetails;
                 }
             }
         }
+    }
 
-        double min, max;
-        minMaxLoc(DEM, &min, &max);
-        if(min < 0) DEM += abs(min);
+    // height of a crater pixel before the DEM shift
+    float Volcano::craterPoint(const Point& p, const DEMHeights& heights)
+    {
+//        float ratioC = crater.pointRatioLinear(imCoor2EllCoor(p));
+//        float ratioC = crater.pointRatioConcave(imCoor2EllCoor(p));
+        float ratioC = crater.pointRatioConvex(imCoor2EllCoor(p), 2.5);
+//        float ratioC = crater.pointRatioCircleBased(imCoor2EllCoor(p), LONG_AXIS);
+//        float ratioC = crater.pointRatioCircleBased(imCoor2EllCoor(p), SHORT_AXIS);
+
+        float craterPointH = (1-ratioC) * (heights.maxH - heights.craterFall);
+        return craterPointH > heights.craterMinH ? craterPointH : heights.craterMinH;
     }
 
-    void Volcano::speckle(cv::Mat& mat, float val)
+    void Volcano::makeCoarseDEMFields(const NoiseEngine& engine)
     {
-        std::default_random_engine generator;
-        std::gamma_distribution<double> distribution(2.0,2.0);
+        int f = options.coarseFactor;
+        int coarseRows = (DEM.rows + f - 1) / f;
+        int coarseCols = (DEM.cols + f - 1) / f;
 
-        for(int i = 0; i < mat.rows; i++)
+        // coarse pixel (i, j) sits where resize() puts it when upsampling by exactly f
+        float origin = 0.5f * f - 0.5f;
+
+        Mat lowNoise;
+        engine.octaves(DEM.rows, DEM.cols, 0, 2, coarseRows, coarseCols, origin, f, lowNoise);
+
+        BaseRatio = Mat(coarseRows, coarseCols, CV_32FC1);
+        OutsideRatio = Mat(coarseRows, coarseCols, CV_32FC1);
+        for (int y = 0; y < coarseRows; y++)
         {
-            for(int j = 0; j < mat.cols; j++)
+            for (int x = 0; x < coarseCols; x++)
             {
-                mat.at<float>(i, j) += distribution(generator);
+                Point2f p(origin + x * f + coorTranVector.x, origin + y * f + coorTranVector.y);
+                BaseRatio.at<float>(y, x) = base.pointRatioCircleBased(p, LONG_AXIS);
+                OutsideRatio.at<float>(y, x) = base.pointRatioConcave(p);
             }
         }
+
+        // both ratios are smooth across the region borders, the regions themselves are still decided per pixel
+        Size upsampled(coarseCols * f, coarseRows * f);
+        Rect crop(0, 0, DEM.cols, DEM.rows);
+        resize(lowNoise, lowNoise, upsampled, 0, 0, INTER_CUBIC);
+        resize(BaseRatio, BaseRatio, upsampled, 0, 0, INTER_CUBIC);
+        resize(OutsideRatio, OutsideRatio, upsampled, 0, 0, INTER_CUBIC);
+        BaseRatio = BaseRatio(crop);
+        OutsideRatio = OutsideRatio(crop);
+
+        Mat fineNoise;
+        engine.octaves(DEM.rows, DEM.cols, 2, 3, DEM.rows, DEM.cols, 0, 1, fineNoise);
+        DEMNoise = lowNoise(crop) + fineNoise;
     }
 
     Point Volcano::imCoor2EllCoor(Point p)
@@ -374,11 +953,15 @@ namespace syntheticVolcano
 
     cv::Mat Volcano::getDEM() { return DEM; }
     cv::Mat Volcano::getDEMNoise() { return DEMNoise; }
+    cv::Mat Volcano::getAlbedo() { return Albedo; }
     cv::Mat Volcano::getReflection() { return Reflection; }
     cv::Mat Volcano::getNormals() { return Normals; }
     cv::Mat Volcano::getDEM2SAR() { return DEM2SAR; }
     cv::Mat Volcano::getReflection2SAR() { return Reflection2SAR; }
+    cv::Mat Volcano::getLayover2SAR() { return Layover2SAR; }
+    cv::Mat Volcano::getShadow2SAR() { return Shadow2SAR; }
     VolcanoData Volcano::getVd() { return vd; }
+    SARGeometry Volcano::getGeometry() { return {angle2sat, ASCENDING, speckleSeed}; }
     Ellipse Volcano::getEllipse(Ellipses e) { return e ? crater : base; }
 
     std::ostream& operator<<(std::ostream& os, Volcano vol)
@@ -6,6 +6,12 @@
 #include "volcanoDataSet.h"
 #include "PerlinNoise.h"
 #include "utils.h"
+#include "kernels.h"
+#include "noiseEngine.h"
+#include "demCache.h"
+#include "taskGraph.h"
+#include "sarImaging.h"
+#include "backscatter.h"
 
 using namespace cv;
 using namespace std;
@@ -24,6 +30,69 @@ namespace syntheticVolcano
         CRATER
     };
 
+    enum LookDirection
+    {
+        ASCENDING,
+        DESCENDING
+    };
+
+    enum ProjectionMode
+    {
+        NATIVE_RANGE,   // one column per slant range pixel, the width depends on the sample
+        FIXED_SHAPE     // range splatted onto outputWidth columns and rows resampled to outputHeight
+    };
+
+    struct VolcanoOptions
+    {
+        ProjectionMode projection = NATIVE_RANGE;
+        int outputWidth = 512;
+        int outputHeight = 512;
+        // FIXED_SHAPE output columns per slant range unit, one value for the whole data set so that the range spacing
+        // and the slopes are comparable between pairs (see Volcano::rangeExtent). 0 stretches every sample's own range
+        // extent over outputWidth
+        float rangeScale = 0;
+        // layover and radar shadow masks of the projected pair
+        bool masks = false;
+        // terrain detail and albedo noise, IMPROVED_PERLIN_3D keeps the original output
+        NoiseEngineType noise = IMPROVED_PERLIN_3D;
+        // > 1: the edifice profile and the two low noise octaves are evaluated every coarseFactor pixels and
+        // upsampled bicubically, only the finest octave and the crater are evaluated per pixel
+        int coarseFactor = 1;
+        // terrain is loaded from / stored to this cache when set, the caller owns it. DEMNoise stays empty on a hit
+        DEMCache* cache = nullptr;
+        // when set, the constructor renders in row bands of tileRows rows on this scheduler: every stage of a band
+        // starts as soon as the bands it reads are done. Same output as the serial path, except that the native range
+        // speckle is drawn per band (seed + band * 0x9E3779B9). Fan-out geometries still run whole image kernels
+        TaskScheduler* scheduler = nullptr;
+        int tileRows = 64;
+        // when set, the projected reflection is imaged through this impulse response with correlated speckle instead
+        // of the additive gamma speckle. Not thread safe, one per Volcano at a time
+        SARImaging* imaging = nullptr;
+        // backscatter model of the reflection, nullptr keeps the original cos(incidence) times albedo
+        const Backscatter* backscatter = nullptr;
+        // keep the native range projection before hole filling, the slant ranges and the speckle draws of the primary
+        // pair, so that update() re-projects only the rows a crater edit reaches. Renders serially, the scheduler is
+        // ignored
+        bool incremental = false;
+    };
+
+    // one viewing geometry of the fan-out mode
+    struct SARGeometry
+    {
+        float angle2sat;
+        LookDirection look;
+        unsigned speckleSeed;
+    };
+
+    struct SARPair
+    {
+        SARGeometry geometry;
+        cv::Mat DEM2SAR;
+        cv::Mat Reflection2SAR;
+        cv::Mat Layover2SAR;
+        cv::Mat Shadow2SAR;
+    };
+
     class Ellipse
     {
     private:
@@ -51,12 +120,14 @@ namespace syntheticVolcano
         bool isPointInside(int x, int y);
         float pointRatioConcave(const Point&);
         float pointRatioConcave(int x, int y);
+        float pointRatioConcave(const Point2f&);
         float pointRatioConvex(const Point&, float);
         float pointRatioConvex(int x, int y, float);
         float pointRatioLinear(const Point&);
         float pointRatioLinear(int x, int y);
         float pointRatioCircleBased(const Point&, AXES);
         float pointRatioCircleBased(int x, int y, AXES);
+        float pointRatioCircleBased(const Point2f&, AXES);
     };
 
     std::ostream& operator<<(std::ostream&, Ellipse);
@@ -64,6 +135,7 @@ namespace syntheticVolcano
     class Volcano {
     private:
         VolcanoData vd;
+        VolcanoOptions options;
         Ellipse base;
         Ellipse crater;
         unsigned SARAvHeight;
@@ -74,31 +146,91 @@ namespace syntheticVolcano
 
         cv::Mat DEM;
         cv::Mat DEMNoise;
+        cv::Mat Albedo;
         cv::Mat Reflection;
         cv::Mat Normals;
         cv::Mat DEM2SAR;
         cv::Mat Reflection2SAR;
+        cv::Mat Layover2SAR;
+        cv::Mat Shadow2SAR;
+        // upsampled profile ratios of the coarse mode, only while the DEM is made
+        cv::Mat BaseRatio;
+        cv::Mat OutsideRatio;
+
+        // edifice heights set by the base slopes, input of the crater pass
+        struct DEMHeights
+        {
+            float maxH;
+            float craterMinH;
+            float craterFall;
+        };
+
+        // state of update(): the crater heights and the shift added to the DEM (unknown on a cache hit), and with
+        // options.incremental the primary projection before hole filling and speckle
+        DEMHeights terrainHeights;
+        bool terrainKnown = false;
+        float terrainShift = 0;
+        unsigned speckleSeed;
+        kernels::RangeGeometry rangeGeometry;
+        float rangeShift = 0;
+        cv::Mat ProjectedDEM;
+        cv::Mat ProjectedReflection;
+        cv::Mat FilledReflection;
+        cv::Mat Speckle;
 
         void makeDEM();
-        void makeReflection();
-        void project();
-
-        void speckle(cv::Mat&, float val=1);
+        void demBaseRows(int y0, int y1, float& maxBaseS, float& rimMin);
+        DEMHeights craterHeights(float maxBaseS, float rimMin) const;
+        void demCraterRows(int y0, int y1, const DEMHeights&);
+        float craterPoint(const Point&, const DEMHeights&);
+        void makeCoarseDEMFields(const NoiseEngine&);
+        void makeNormals();
+        void makeAlbedo();
+        void makeReflection(const cv::Vec3f&, cv::Mat&);
+        void reflectRows(const cv::Vec3f&, cv::Mat&, int y0, int y1);
+        void renderTiled(bool makeTerrain, uint64_t cacheKey);
+        void projectTiled(TaskGraph&, const std::vector<TaskGraph::Task>& demReady, TaskGraph::Task reflectionReady);
+        void project(const cv::Vec3f&, const cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, unsigned);
+        void projectPrimary();
+        void reprojectRows(int y0, int y1);
+        void addSpeckle(int y0, int y1);
+        static int refillRows(const cv::Mat& projected, cv::Mat& filled, int y0, int y1);
 
         Point imCoor2EllCoor(Point);
 
     public:
-        explicit Volcano(VolcanoData, unsigned _SARAvHeight=851, float _angle2sat=1.39626);
+        explicit Volcano(VolcanoData, unsigned _SARAvHeight=851, float _angle2sat=1.39626,
+                         const VolcanoOptions& _options=VolcanoOptions());
 
         cv::Mat getDEM();
         cv::Mat getDEMNoise();
+        cv::Mat getAlbedo();
         cv::Mat getReflection();
         cv::Mat getNormals();
         cv::Mat getDEM2SAR();
         cv::Mat getReflection2SAR();
+        // layover and radar shadow masks (CV_8UC1, 0/255) aligned with the projected pair, empty unless options.masks
+        cv::Mat getLayover2SAR();
+        cv::Mat getShadow2SAR();
 
         VolcanoData getVd ();
+        // viewing geometry of the primary pair (getDEM2SAR / getReflection2SAR)
+        SARGeometry getGeometry();
         Ellipse getEllipse(Ellipses);
+
+        // Re-render for new parameters. A change of craterMinHeightRatio or craterFallRatio recomputes only the crater
+        // pixels, the normals and reflection one pixel around them and, with options.incremental, the projected rows
+        // they reach; the fields the renderer does not read are only recorded. Any other change, or a crater edit that
+        // moves the DEM shift or the range extent, renders from scratch (the range extent only re-projects).
+        // Returns false when the whole volcano was rendered again
+        bool update(const VolcanoData&);
+
+        // Re-project the already computed DEM, normals and albedo for every geometry
+        std::vector<SARPair> fanOut(const std::vector<SARGeometry>&);
+
+        static cv::Vec3f lookVector(float, LookDirection);
+        // largest slant range extent (native range width - 1) of a size x size DEM no higher than maxHeight
+        static float rangeExtent(unsigned size, float angle2sat, float maxHeight);
     };
 
     std::ostream& operator<<(std::ostream&, Volcano);
@@ -1,4 +1,5 @@
 #include "volcanoDataSet.h"
+#include <limits>
 
 //-------------------------------------------------------------------------
 // DEM variables
@@ -23,7 +24,11 @@ VolcanoData generateVolcanoData (std::mt19937 generator)
 {
 // check for underflow
 int underflowIndicator = 9000;
+bool underflow;
+VolcanoData volcanoData;
 
+do
+{
 // volcano height
     static std::normal_distribution<float> heightDis(4400, 580); // [2000, 6800]
     float heightMeters = heightDis(generator);
@@ -72,7 +77,7 @@ int underflowIndicator = 9000;
     auto craterY = static_cast<unsigned>((baseCenterPoint.y * yShift + baseCenterPoint.y));
     Point craterCenterPoint(craterX, craterY);
 
-    VolcanoData volcanoData = VolcanoData();
+    volcanoData = VolcanoData();
 
     volcanoData.height = heightMeters;
     volcanoData.craterMaxHeight = heightMeters - craterFallMeters;
@@ -87,20 +92,272 @@ int underflowIndicator = 9000;
     volcanoData.baseCenter = baseCenterPoint;
     volcanoData.craterCenter = craterCenterPoint;
 
-    // in case of underflow
-    if(craterMinHeightRatio > underflowIndicator ||
-       craterFallMeters > underflowIndicator     ||
-       BA1Pixels > underflowIndicator            ||
-       BA2Pixels > underflowIndicator            ||
-       CA1Pixels > underflowIndicator            ||
-       CA2Pixels > underflowIndicator            ||
-       craterX > underflowIndicator              ||
-       craterY > underflowIndicator)
-    { return  generateVolcanoData (generator); }
+    // in case of underflow draw again
+    underflow = craterMinHeightRatio > underflowIndicator ||
+                craterFallMeters > underflowIndicator     ||
+                BA1Pixels > underflowIndicator            ||
+                BA2Pixels > underflowIndicator            ||
+                CA1Pixels > underflowIndicator            ||
+                CA2Pixels > underflowIndicator            ||
+                craterX > underflowIndicator              ||
+                craterY > underflowIndicator;
+} while(underflow);
 
     return volcanoData;
 }
 
+//-------------------------------------------------------------------------
+// Batch sampler
+//
+// Same parameter model as generateVolcanoData, but every ratio is drawn from its gaussian truncated to the range
+// stated above, a whole column at a time, by inverse CDF: no draw is rejected. Samples whose crater does not fit
+// inside the base are re-drawn as a whole and their acceptance is reported; those still out after
+// maxRejectionRounds have the crater shrunk and moved into the base.
+
+static const int maxRejectionRounds = 64;
+
+// standard normal CDF
+static double normalCDF (double x)
+{
+    return 0.5 * std::erfc(-x / std::sqrt(2.0));
+}
+
+// inverse of normalCDF on (0, 1): Acklam's rational approximation and one Halley step
+static double normalQuantile (double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549671010229868e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    const double pLow = 0.02425;
+
+    if (p <= 0) return -std::numeric_limits<double>::infinity();
+    if (p >= 1) return std::numeric_limits<double>::infinity();
+
+    double x;
+    if (p < pLow || p > 1 - pLow)
+    {
+        double q = std::sqrt(-2 * std::log(p < pLow ? p : 1 - p));
+        x = (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+            ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+        if (p > 1 - pLow) x = -x;
+    }
+    else
+    {
+        double q = p - 0.5;
+        double r = q * q;
+        x = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5]) * q /
+            (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+    }
+
+    double e = normalCDF(x) - p;
+    double u = e * std::sqrt(2 * M_PI) * std::exp(x * x / 2);
+    return x - u / (1 + x * u / 2);
+}
+
+// Fill column with draws of N(mean, sd) truncated to [lo, hi]: u ~ U(Phi(a), Phi(b)), x = Phi^-1(u) with a, b the
+// standardized bounds. A range above the mean is sampled mirrored below it, where the CDF keeps its precision.
+static void sampleTruncatedNormal (std::mt19937& generator, float mean, float sd, float lo, float hi,
+                                   std::vector<float>& column)
+{
+    bool mirrored = lo > mean;
+    double a = mirrored ? (mean - hi) / sd : (lo - mean) / sd;
+    double b = mirrored ? (mean - lo) / sd : (hi - mean) / sd;
+    double pa = normalCDF(a);
+    double pb = normalCDF(b);
+
+    size_t n = column.size();
+    std::vector<double> block(n);
+    for (size_t i = 0; i < n; i++) block[i] = std::generate_canonical<double, 53>(generator);
+    for (size_t i = 0; i < n; i++)
+    {
+        double z = std::min(std::max(normalQuantile(pa + (pb - pa) * block[i]), a), b);
+        // min / max only absorb the rounding of Phi and Phi^-1 at the ends of the range
+        column[i] = std::min(std::max((float)(mirrored ? mean - sd * z : mean + sd * z), lo), hi);
+    }
+}
+
+SamplerReport generateVolcanoDataBatch (std::mt19937& generator, size_t n, VolcanoDataBatch& batch)
+{
+    SamplerReport report;
+    report.fields.assign(1, FieldAcceptance{"sample", 0, 0, 0});
+    FieldAcceptance& sample = report.fields[0];
+    batch.resize(n);
+
+    // batch slots still waiting for a valid sample
+    std::vector<size_t> pending(n);
+    std::iota(pending.begin(), pending.end(), 0);
+
+    std::vector<float> heightMeters, craterMinHeightRatio, craterFallRatio, volcanoH2DRatio, baseLA2SARatio,
+                       volcanoBA2CARatio, craterLA2SARatio, xShift, yShift;
+    std::vector<float> BA1Meters, BA2Meters, CA1Meters, CA2Meters;
+
+    for (int round = 0; !pending.empty(); round++)
+    {
+        size_t m = pending.size();
+        for (std::vector<float>* c : {&heightMeters, &craterMinHeightRatio, &craterFallRatio, &volcanoH2DRatio,
+                                      &baseLA2SARatio, &volcanoBA2CARatio, &craterLA2SARatio, &xShift, &yShift,
+                                      &BA1Meters, &BA2Meters, &CA1Meters, &CA2Meters})
+            c->resize(m);
+
+        sampleTruncatedNormal(generator, 4400, 580, 2000, 6800, heightMeters);
+        sampleTruncatedNormal(generator, 0.85, 0.02, 0.77, 0.93, craterMinHeightRatio);
+        sampleTruncatedNormal(generator, 0.135, 0.03, 0.03, 0.24, craterFallRatio);
+        sampleTruncatedNormal(generator, 0.21, 0.037, 0.051, 0.25, volcanoH2DRatio);
+        sampleTruncatedNormal(generator, 0.85, 0.15, 0.8, 0.99, baseLA2SARatio);
+        sampleTruncatedNormal(generator, 0.11, 0.08, 0.1, 0.4, volcanoBA2CARatio);
+        sampleTruncatedNormal(generator, 0.85, 0.15, 0.9, 1, craterLA2SARatio);
+        sampleTruncatedNormal(generator, 0, 0.01, -0.33, 0.33, xShift);
+        sampleTruncatedNormal(generator, 0, 0.01, -0.33, 0.33, yShift);
+
+        for (size_t k = 0; k < m; k++)
+        {
+            BA1Meters[k] = (heightMeters[k]/volcanoH2DRatio[k])/(2*M_PI);
+            BA2Meters[k] = BA1Meters[k] * baseLA2SARatio[k];
+            CA1Meters[k] = BA1Meters[k] * volcanoBA2CARatio[k];
+            CA2Meters[k] = CA1Meters[k] * craterLA2SARatio[k];
+        }
+
+        // whole-sample rejection: the crater has to lie inside the base
+        std::vector<size_t> rejected;
+        bool lastRound = round + 1 >= maxRejectionRounds;
+        for (size_t k = 0; k < m; k++)
+        {
+            auto BA1Pixels = static_cast<unsigned>(BA1Meters[k]/4);
+            auto BA2Pixels = static_cast<unsigned>(BA2Meters[k]/4);
+            auto CA1Pixels = static_cast<unsigned>(CA1Meters[k]/4);
+            auto CA2Pixels = static_cast<unsigned>(CA2Meters[k]/4);
+            auto craterX = static_cast<int>(BA1Pixels * xShift[k] + BA1Pixels);
+            auto craterY = static_cast<int>(BA2Pixels * yShift[k] + BA2Pixels);
+
+            bool fits = CA1Pixels > 0 && CA2Pixels > 0 &&
+                        abs(craterX - (int)BA1Pixels) + CA1Pixels <= BA1Pixels &&
+                        abs(craterY - (int)BA2Pixels) + CA2Pixels <= BA2Pixels;
+
+            sample.drawn++;
+            if (!fits && !lastRound)
+            {
+                rejected.push_back(pending[k]);
+                continue;
+            }
+            if (fits)
+            {
+                sample.accepted++;
+            }
+            else
+            {
+                // out of rounds: shrink the crater to the base and pull its centre in until it lies inside
+                CA1Pixels = std::min(std::max(CA1Pixels, 1u), BA1Pixels);
+                CA2Pixels = std::min(std::max(CA2Pixels, 1u), BA2Pixels);
+                int limitX = (int)(BA1Pixels - CA1Pixels);
+                int limitY = (int)(BA2Pixels - CA2Pixels);
+                craterX = (int)BA1Pixels + std::min(std::max(craterX - (int)BA1Pixels, -limitX), limitX);
+                craterY = (int)BA2Pixels + std::min(std::max(craterY - (int)BA2Pixels, -limitY), limitY);
+                sample.repaired++;
+            }
+
+            size_t i = pending[k];
+            float craterMinHeightMeters = heightMeters[k] * craterMinHeightRatio[k];
+            float craterFallMeters = (heightMeters[k] - craterMinHeightMeters) * craterFallRatio[k];
+
+            batch.height[i] = heightMeters[k];
+            batch.craterMaxHeight[i] = heightMeters[k] - craterFallMeters;
+            batch.craterMinHeight[i] = craterMinHeightMeters;
+            batch.craterMinHeightRatio[i] = craterMinHeightRatio[k];
+            batch.craterFall[i] = craterFallMeters;
+            batch.craterFallRatio[i] = craterFallRatio[k];
+            batch.baseLongAxisPixels[i] = BA1Pixels;
+            batch.baseShortAxisPixels[i] = BA2Pixels;
+            batch.craterLongAxisPixels[i] = CA1Pixels;
+            batch.craterShortAxisPixels[i] = CA2Pixels;
+            batch.baseCenterX[i] = BA1Pixels;
+            batch.baseCenterY[i] = BA2Pixels;
+            batch.craterCenterX[i] = craterX;
+            batch.craterCenterY[i] = craterY;
+        }
+        pending.swap(rejected);
+    }
+
+    return report;
+}
+
+// Batch indices ordered by decreasing estimated generation cost (base ellipse area), for longest-first scheduling
+std::vector<size_t> costOrder (const VolcanoDataBatch& batch)
+{
+    std::vector<size_t> order(batch.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&batch](size_t a, size_t b)
+    {
+        return (double)batch.baseLongAxisPixels[a] * batch.baseShortAxisPixels[a] >
+               (double)batch.baseLongAxisPixels[b] * batch.baseShortAxisPixels[b];
+    });
+
+    return order;
+}
+
+size_t VolcanoDataBatch::size() const
+{
+    return height.size();
+}
+
+void VolcanoDataBatch::resize(size_t n)
+{
+    height.resize(n);
+    craterMaxHeight.resize(n);
+    craterMinHeight.resize(n);
+    craterMinHeightRatio.resize(n);
+    craterFall.resize(n);
+    craterFallRatio.resize(n);
+    baseLongAxisPixels.resize(n);
+    baseShortAxisPixels.resize(n);
+    craterLongAxisPixels.resize(n);
+    craterShortAxisPixels.resize(n);
+    baseCenterX.resize(n);
+    baseCenterY.resize(n);
+    craterCenterX.resize(n);
+    craterCenterY.resize(n);
+}
+
+VolcanoData VolcanoDataBatch::get(size_t i) const
+{
+    VolcanoData volcanoData = VolcanoData();
+
+    volcanoData.height = height[i];
+    volcanoData.craterMaxHeight = craterMaxHeight[i];
+    volcanoData.craterMinHeight = craterMinHeight[i];
+    volcanoData.craterMinHeightRatio = craterMinHeightRatio[i];
+    volcanoData.craterFall = craterFall[i];
+    volcanoData.craterFallRatio = craterFallRatio[i];
+    volcanoData.baseLongAxisPixels = baseLongAxisPixels[i];
+    volcanoData.baseShortAxisPixels = baseShortAxisPixels[i];
+    volcanoData.craterLongAxisPixels = craterLongAxisPixels[i];
+    volcanoData.craterShortAxisPixels = craterShortAxisPixels[i];
+    volcanoData.baseCenter = Point(baseCenterX[i], baseCenterY[i]);
+    volcanoData.craterCenter = Point(craterCenterX[i], craterCenterY[i]);
+
+    return volcanoData;
+}
+
+double FieldAcceptance::rate() const
+{
+    return drawn == 0 ? 1.0 : (double)accepted / drawn;
+}
+
+std::ostream& operator<<(std::ostream& os, const SamplerReport& report)
+{
+    os << "Sampler accept rates:";
+    for (const FieldAcceptance& fa : report.fields)
+    {
+        os << "\n" << setw(22) << fa.name << ": " << fa.rate() << " (" << fa.accepted << "/" << fa.drawn << ")";
+        if (fa.repaired) os << ", repaired " << fa.repaired;
+    }
+    return os << endl;
+}
+
 std::ostream &operator<<(std::ostream &os, const VolcanoData vd) {
     return os << "Height meters: "           << vd.height                <<
               "\nCrater fall: "              << vd.craterFall            <<
@@ -4,6 +4,9 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <random>
+#include <vector>
+#include <numeric>
+#include <algorithm>
 #include <math.h>
 
 using namespace cv;
@@ -23,6 +26,9 @@ struct VolcanoData
     unsigned craterShortAxisPixels;
     Point baseCenter;
     Point craterCenter;
+    // noise seeds of the DEM and the albedo, 0: drawn with std::rand() by Volcano and recorded here
+    unsigned demSeed = 0;
+    unsigned albedoSeed = 0;
 };
 
 struct ImagesSet
@@ -42,7 +48,50 @@ struct DataSet
     cv::Mat projectedReflectionNormalGrads;
 };
 
+// Structure-of-arrays block of sampled volcano parameters, entry i of every column belongs to sample i
+struct VolcanoDataBatch
+{
+    std::vector<float> height;
+    std::vector<float> craterMaxHeight;
+    std::vector<float> craterMinHeight;
+    std::vector<float> craterMinHeightRatio;
+    std::vector<float> craterFall;
+    std::vector<float> craterFallRatio;
+    std::vector<unsigned> baseLongAxisPixels;
+    std::vector<unsigned> baseShortAxisPixels;
+    std::vector<unsigned> craterLongAxisPixels;
+    std::vector<unsigned> craterShortAxisPixels;
+    std::vector<int> baseCenterX;
+    std::vector<int> baseCenterY;
+    std::vector<int> craterCenterX;
+    std::vector<int> craterCenterY;
+
+    size_t size() const;
+    void resize(size_t);
+    VolcanoData get(size_t) const;
+};
+
+// Acceptance bookkeeping of one rejection loop of the batch sampler
+struct FieldAcceptance
+{
+    string name;
+    size_t drawn;
+    size_t accepted;
+    // accepted after being changed to fit
+    size_t repaired;
+
+    double rate() const;
+};
+
+struct SamplerReport
+{
+    std::vector<FieldAcceptance> fields;
+};
+
 std::ostream& operator<<(std::ostream&, VolcanoData);
+std::ostream& operator<<(std::ostream&, const SamplerReport&);
 VolcanoData generateVolcanoData (std::mt19937);
+SamplerReport generateVolcanoDataBatch (std::mt19937&, size_t, VolcanoDataBatch&);
+std::vector<size_t> costOrder (const VolcanoDataBatch&);
 
 #endif //HEIGHTMAP_VOLCANODATASET_H
\ No newline at end of file